@@ -0,0 +1,128 @@
+/*
+ * apex_arena.c
+ * Contains the arena every APEX_CPU and its program are allocated from. An
+ * arena is one mapping of reserved address space, filled from the start
+ * and emptied back to a mark, so a CPU reloaded with APEX_cpu_reset reuses
+ * pages that are already mapped in
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <string.h>
+#include <sys/mman.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+struct APEX_Arena
+{
+    size_t size;                   /* Bytes mapped, this header included */
+    size_t used;                   /* Bytes handed out, this header included */
+};
+
+/* Bytes of the header, allocations start on a cache line after it */
+#define ARENA_HEADER_SIZE                                                      \
+    ((sizeof(APEX_Arena) + CODE_MEMORY_ALIGN - 1)                              \
+     & ~(size_t)(CODE_MEMORY_ALIGN - 1))
+
+/*
+ * Maps an arena of size bytes, rounded up to huge pages. Only the pages
+ * used are backed by memory, by huge pages if huge_pages is set and the
+ * kernel agrees.
+ *
+ * Returns NULL if the mapping failed
+ */
+APEX_Arena *
+APEX_arena_create(size_t size, int huge_pages)
+{
+    APEX_Arena *arena;
+
+    size = (size + ARENA_HUGE_PAGE_SIZE - 1)
+           & ~(size_t)(ARENA_HUGE_PAGE_SIZE - 1);
+    arena = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+#ifdef MADV_HUGEPAGE
+    /* Only a hint, the arena works without huge pages */
+    if (huge_pages)
+    {
+        madvise(arena, size, MADV_HUGEPAGE);
+    }
+#endif
+
+    arena->size = size;
+    arena->used = ARENA_HEADER_SIZE;
+    return arena;
+}
+
+/*
+ * Takes bytes of zeroed memory from the arena, on a cache line.
+ *
+ * Returns NULL if the arena is full
+ */
+void *
+APEX_arena_alloc(APEX_Arena *arena, size_t bytes)
+{
+    unsigned char *memory;
+
+    bytes = (bytes + CODE_MEMORY_ALIGN - 1) & ~(size_t)(CODE_MEMORY_ALIGN - 1);
+    if (bytes > arena->size - arena->used)
+    {
+        return NULL;
+    }
+
+    memory = (unsigned char *)arena + arena->used;
+    arena->used += bytes;
+
+    /* Pages given back by APEX_arena_release keep their contents */
+    memset(memory, 0, bytes);
+    return memory;
+}
+
+/*
+ * Returns TRUE if memory was taken from arena, FALSE as well if arena is
+ * NULL
+ */
+int
+APEX_arena_owns(const APEX_Arena *arena, const void *memory)
+{
+    const unsigned char *start = (const unsigned char *)arena;
+
+    return arena && (const unsigned char *)memory >= start
+           && (const unsigned char *)memory < start + arena->size;
+}
+
+/*
+ * Returns the mark of everything allocated so far, see APEX_arena_release
+ */
+size_t
+APEX_arena_mark(const APEX_Arena *arena)
+{
+    return arena->used;
+}
+
+/*
+ * Gives back everything allocated after mark was taken, keeping its pages
+ */
+void
+APEX_arena_release(APEX_Arena *arena, size_t mark)
+{
+    arena->used = mark;
+}
+
+/*
+ * Unmaps the arena, and everything allocated from it with it
+ */
+void
+APEX_arena_destroy(APEX_Arena *arena)
+{
+    if (arena)
+    {
+        munmap(arena, arena->size);
+    }
+}
@@ -0,0 +1,571 @@
+/*
+ * apex_asm.c
+ * Contains the assembler, which turns a program into the binary image the
+ * simulator maps in, see APEX_Image_Header. Instructions are written as in
+ * input files, and besides:
+ *
+ *   loop:              labels the next instruction, or data word
+ *   BNZ #loop          branches to a label, the offset is worked out
+ *   MOVC R1,#table     takes the address of a label as an immediate
+ *   .data, .text       switch between data memory and code memory
+ *   .word 5, -1, loop  initializes the next words of data memory
+ *   .space 4           skips words of data memory, left zero
+ *   ; comment          runs to the end of the line
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Operands of every instruction, indexed by numeric opcode */
+static const int opcode_operands[NUM_OPCODES] = {
+    [OPCODE_ADD] = 3,  [OPCODE_SUB] = 3,   [OPCODE_MUL] = 3,
+    [OPCODE_DIV] = 3,  [OPCODE_AND] = 3,   [OPCODE_OR] = 3,
+    [OPCODE_XOR] = 3,  [OPCODE_MOVC] = 2,  [OPCODE_LOAD] = 3,
+    [OPCODE_STORE] = 3, [OPCODE_BZ] = 1,   [OPCODE_BNZ] = 1,
+    [OPCODE_HALT] = 0, [OPCODE_STR] = 3,   [OPCODE_LDR] = 3,
+    [OPCODE_ADDL] = 3, [OPCODE_SUBL] = 3,  [OPCODE_CMP] = 2,
+};
+
+/* Longest label, and most operands of an instruction */
+#define ASM_LABEL_SIZE 64
+#define ASM_MAX_OPERANDS 3
+
+/* Most words of one .word line, and of data memory in all */
+#define ASM_MAX_WORDS 256
+#define ASM_MAX_DATA (1 << 28)
+
+typedef struct APEX_Label
+{
+    char name[ASM_LABEL_SIZE];
+    int value;                     /* PC, or data memory address */
+    int in_code;                   /* Labels an instruction */
+} APEX_Label;
+
+typedef struct APEX_Assembler
+{
+    const char *filename;
+    int line_number;
+    int pass;                      /* 1 defines labels, 2 emits */
+    int in_data;                   /* Lines go to data memory */
+    APEX_Label *labels;
+    int num_labels;
+    int label_capacity;
+    APEX_Instruction *code;        /* Sized in pass 1 */
+    int num_insns;
+    int *data;                     /* Sized in pass 1 */
+    int num_data;
+    int errors;
+} APEX_Assembler;
+
+static void
+asm_error(APEX_Assembler *as, const char *message, const char *what)
+{
+    fprintf(stderr, "APEX_Error: %s:%d: %s%s%s\n", as->filename,
+            as->line_number, message, what ? " " : "", what ? what : "");
+    as->errors++;
+}
+
+/* Removes white space from both ends of text, in place */
+static char *
+trim(char *text)
+{
+    char *end;
+
+    while (isspace((unsigned char)*text))
+    {
+        text++;
+    }
+    end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1]))
+    {
+        *--end = '\0';
+    }
+    return text;
+}
+
+/* Returns TRUE for R0 to R15 style register names */
+static int
+is_register(const char *text)
+{
+    if (text[0] != 'R' || !isdigit((unsigned char)text[1]))
+    {
+        return FALSE;
+    }
+    for (text++; *text; text++)
+    {
+        if (!isdigit((unsigned char)*text))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static int
+is_label_name(const char *text)
+{
+    if (!isalpha((unsigned char)*text) && *text != '_' && *text != '.')
+    {
+        return FALSE;
+    }
+    for (text++; *text; text++)
+    {
+        if (!isalnum((unsigned char)*text) && *text != '_' && *text != '.')
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Parses a decimal number, the whole of text.
+ *
+ * Returns FALSE if text is not one
+ */
+static int
+parse_number(const char *text, int *value)
+{
+    char *end;
+    long number;
+
+    if (!*text)
+    {
+        return FALSE;
+    }
+    number = strtol(text, &end, 10);
+    if (*end || number < -2147483647L - 1 || number > 2147483647L)
+    {
+        return FALSE;
+    }
+    *value = (int)number;
+    return TRUE;
+}
+
+static APEX_Label *
+find_label(APEX_Assembler *as, const char *name)
+{
+    int i;
+
+    for (i = 0; i < as->num_labels; i++)
+    {
+        if (strcmp(as->labels[i].name, name) == 0)
+        {
+            return &as->labels[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Defines name at the current instruction or data word, in pass 1
+ */
+static void
+define_label(APEX_Assembler *as, const char *name)
+{
+    APEX_Label *grown;
+    APEX_Label *label;
+
+    if (as->pass != 1)
+    {
+        return;
+    }
+    if (!is_label_name(name) || is_register(name)
+        || strlen(name) >= ASM_LABEL_SIZE)
+    {
+        asm_error(as, "Bad label", name);
+        return;
+    }
+    if (find_label(as, name))
+    {
+        asm_error(as, "Label defined twice:", name);
+        return;
+    }
+
+    if (as->num_labels == as->label_capacity)
+    {
+        as->label_capacity = as->label_capacity ? 2 * as->label_capacity : 64;
+        grown = realloc(as->labels, as->label_capacity * sizeof(APEX_Label));
+        if (!grown)
+        {
+            asm_error(as, "Out of memory", NULL);
+            return;
+        }
+        as->labels = grown;
+    }
+
+    label = &as->labels[as->num_labels++];
+    strcpy(label->name, name);
+    label->in_code = !as->in_data;
+    label->value = as->in_data ? as->num_data : 4000 + 4 * as->num_insns;
+}
+
+/*
+ * Evaluates a number or a label. A branch takes the offset of a code label
+ * from the PC of the branch.
+ *
+ * Returns FALSE if text is neither
+ */
+static int
+evaluate(APEX_Assembler *as, const char *text, int branch, int *value)
+{
+    const APEX_Label *label;
+
+    if (parse_number(text, value))
+    {
+        return TRUE;
+    }
+
+    label = find_label(as, text);
+    if (!label)
+    {
+        asm_error(as, "Undefined label", text);
+        return FALSE;
+    }
+    if (branch && !label->in_code)
+    {
+        asm_error(as, "Branch to a data label", text);
+        return FALSE;
+    }
+    *value = branch ? label->value - (4000 + 4 * as->num_insns) : label->value;
+    return TRUE;
+}
+
+/*
+ * Splits text on commas into at most max trimmed fields.
+ *
+ * Returns the number of fields, or max + 1 if there are more
+ */
+static int
+split_fields(char *text, char **fields, int max)
+{
+    int n = 0;
+    char *comma;
+
+    if (!*trim(text))
+    {
+        return 0;
+    }
+    for (;;)
+    {
+        comma = strchr(text, ',');
+        if (comma)
+        {
+            *comma = '\0';
+        }
+        if (n == max)
+        {
+            return max + 1;
+        }
+        fields[n++] = trim(text);
+        if (!comma)
+        {
+            return n;
+        }
+        text = comma + 1;
+    }
+}
+
+/*
+ * Assembles the data directive in text
+ */
+static void
+assemble_directive(APEX_Assembler *as, char *text)
+{
+    char *fields[ASM_MAX_WORDS + 1];
+    char *args;
+    int count;
+    int value;
+    int i;
+
+    args = text + strcspn(text, " \t");
+    if (*args)
+    {
+        *args++ = '\0';
+    }
+
+    if (strcmp(text, ".data") == 0 || strcmp(text, ".text") == 0)
+    {
+        as->in_data = text[1] == 'd';
+        return;
+    }
+    if (!as->in_data)
+    {
+        asm_error(as, "Directive outside .data:", text);
+        return;
+    }
+
+    if (strcmp(text, ".space") == 0)
+    {
+        if (!parse_number(trim(args), &count) || count < 0
+            || count > ASM_MAX_DATA - as->num_data)
+        {
+            asm_error(as, "Bad .space, or data memory is full", NULL);
+            return;
+        }
+        as->num_data += count;
+        return;
+    }
+
+    if (strcmp(text, ".word") != 0)
+    {
+        asm_error(as, "Unknown directive", text);
+        return;
+    }
+
+    count = split_fields(args, fields, ASM_MAX_WORDS);
+    if (count == 0 || count > ASM_MAX_WORDS
+        || count > ASM_MAX_DATA - as->num_data)
+    {
+        asm_error(as, "Empty or long .word, or data memory is full", NULL);
+        return;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (as->pass == 2 && evaluate(as, fields[i], FALSE, &value))
+        {
+            as->data[as->num_data] = value;
+        }
+        as->num_data++;
+    }
+}
+
+/*
+ * Assembles the instruction in text, in pass 2 with every operand turned
+ * into the form of input files and parsed by their parser
+ */
+static void
+assemble_instruction(APEX_Assembler *as, char *text)
+{
+    char *fields[ASM_MAX_OPERANDS + 1];
+    char canonical[256];
+    char *operand;
+    char *args;
+    int opcode;
+    int count;
+    int value;
+    int used;
+    int i;
+
+    if (as->in_data)
+    {
+        asm_error(as, "Instruction in .data:", text);
+        return;
+    }
+    if (as->pass == 1)
+    {
+        as->num_insns++;
+        return;
+    }
+
+    args = text + strcspn(text, " \t");
+    if (*args)
+    {
+        *args++ = '\0';
+    }
+
+    opcode = find_opcode(text);
+    if (opcode < 0)
+    {
+        asm_error(as, "Unknown instruction", text);
+        as->num_insns++;
+        return;
+    }
+
+    count = split_fields(args, fields, ASM_MAX_OPERANDS);
+    if (count != opcode_operands[opcode])
+    {
+        asm_error(as, "Wrong number of operands for", text);
+        as->num_insns++;
+        return;
+    }
+
+    used = snprintf(canonical, sizeof(canonical), "%s", text);
+    for (i = 0; i < count; i++)
+    {
+        operand = fields[i];
+        if (is_register(operand))
+        {
+            if (atoi(operand + 1) >= REG_FILE_SIZE)
+            {
+                asm_error(as, "No such register", operand);
+            }
+            used += snprintf(canonical + used, sizeof(canonical) - used,
+                             "%s%s", i ? "," : " ", operand);
+            continue;
+        }
+
+        /* Immediates take a #, labels may go without */
+        if (operand[0] == '#')
+        {
+            operand++;
+        }
+        if (!evaluate(as, operand, opcode == OPCODE_BZ || opcode == OPCODE_BNZ,
+                      &value))
+        {
+            value = 0;
+        }
+        used += snprintf(canonical + used, sizeof(canonical) - used, "%s#%d",
+                         i ? "," : " ", value);
+    }
+
+    parse_instruction(&as->code[as->num_insns], canonical);
+    as->num_insns++;
+}
+
+/*
+ * Assembles one source line, labels first
+ */
+static void
+assemble_line(APEX_Assembler *as, char *line)
+{
+    char *colon;
+    char *text;
+
+    line[strcspn(line, ";")] = '\0';
+    text = trim(line);
+
+    while ((colon = strchr(text, ':')) != NULL)
+    {
+        *colon = '\0';
+        define_label(as, trim(text));
+        text = trim(colon + 1);
+    }
+
+    if (!*text)
+    {
+        return;
+    }
+    if (text[0] == '.')
+    {
+        assemble_directive(as, text);
+    }
+    else
+    {
+        assemble_instruction(as, text);
+    }
+}
+
+/*
+ * Runs one pass over the source
+ */
+static void
+assemble_pass(APEX_Assembler *as, FILE *fp, int pass)
+{
+    char *line = NULL;
+    size_t len = 0;
+
+    rewind(fp);
+    as->pass = pass;
+    as->in_data = FALSE;
+    as->num_insns = 0;
+    as->num_data = 0;
+    as->line_number = 0;
+
+    while (getline(&line, &len, fp) != -1)
+    {
+        as->line_number++;
+        assemble_line(as, line);
+    }
+    free(line);
+}
+
+/*
+ * Writes the image of the assembled program to filename.
+ *
+ * Returns FALSE if it could not be written
+ */
+static int
+write_image(const APEX_Assembler *as, const char *filename)
+{
+    APEX_Image_Header header;
+    FILE *fp;
+    int written;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, APEX_IMAGE_MAGIC, sizeof(APEX_IMAGE_MAGIC));
+    header.version = APEX_IMAGE_VERSION;
+    header.num_insns = as->num_insns;
+    header.num_data = as->num_data;
+
+    fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        return FALSE;
+    }
+    written = fwrite(&header, sizeof(header), 1, fp) == 1
+              && fwrite(as->code, sizeof(APEX_Instruction), as->num_insns, fp)
+                     == (size_t)as->num_insns
+              && fwrite(as->data, sizeof(int), as->num_data, fp)
+                     == (size_t)as->num_data;
+    return fclose(fp) == 0 && written;
+}
+
+int
+main(int argc, char const *argv[])
+{
+    APEX_Assembler as;
+    FILE *fp;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> <output_file>\n",
+                argv[0]);
+        exit(1);
+    }
+
+    fp = fopen(argv[1], "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open %s\n", argv[1]);
+        exit(1);
+    }
+
+    memset(&as, 0, sizeof(as));
+    as.filename = argv[1];
+
+    /* Labels may be used before they are defined, pass 1 finds them all */
+    assemble_pass(&as, fp, 1);
+    if (as.num_insns == 0 && !as.errors)
+    {
+        asm_error(&as, "No instructions", NULL);
+    }
+    if (!as.errors)
+    {
+        as.code = calloc(as.num_insns, sizeof(APEX_Instruction));
+        as.data = calloc(as.num_data ? as.num_data : 1, sizeof(int));
+        if (!as.code || !as.data)
+        {
+            asm_error(&as, "Out of memory", NULL);
+        }
+    }
+    if (!as.errors)
+    {
+        assemble_pass(&as, fp, 2);
+    }
+    fclose(fp);
+
+    if (!as.errors && !write_image(&as, argv[2]))
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", argv[2]);
+        as.errors++;
+    }
+    if (!as.errors)
+    {
+        printf("APEX_ASM: %d instructions, %d data words written to %s\n",
+               as.num_insns, as.num_data, argv[2]);
+    }
+
+    free(as.code);
+    free(as.data);
+    free(as.labels);
+    return as.errors ? 1 : 0;
+}
@@ -0,0 +1,880 @@
+/*
+ * apex_batch.c
+ * Contains the batch engine, which runs many independent APEX pipelines in
+ * lockstep, one per SIMD lane
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* How an instance ended */
+#define BATCH_RUNNING 0x0
+#define BATCH_HALTED 0x1
+#define BATCH_DEADLOCKED 0x2
+#define BATCH_STOPPED 0x3          /* Reached the cycle limit */
+#define BATCH_FAULTED 0x4          /* Left its code or data memory */
+
+/* Helpers are always inlined, so that they are compiled for the target of
+ * the kernel calling them and vectors are never passed by value */
+#define VEC_INLINE static inline __attribute__((always_inline))
+
+/* The kernel is built once per instruction set and picked at load time,
+ * where the toolchain supports it */
+#if defined(__x86_64__) && defined(__unix__) && defined(__GNUC__)
+#define BATCH_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define BATCH_KERNEL
+#endif
+
+/* One int per lane. Comparisons give lane masks, all bits set for TRUE */
+typedef int apex_vec __attribute__((vector_size(APEX_BATCH_WIDTH * sizeof(int))));
+
+/* Packing of APEX_Batch_Insn.fields */
+#define FIELD_OPCODE_MASK 0x1f
+#define FIELD_REG_MASK 0xf
+#define FIELD_RD_SHIFT 5
+#define FIELD_RS1_SHIFT 9
+#define FIELD_RS2_SHIFT 13
+#define FIELD_FLAGS_SHIFT 17           /* INSN_* */
+
+/* One instruction of every lane of a group, see APEX_Instruction and
+ * APEX_Insn_Deps. Fields are packed, so that moving an instruction between
+ * latches takes three vectors */
+typedef struct APEX_Batch_Insn
+{
+    apex_vec fields;               /* Opcode, rd, rs1, rs2 and flags */
+    apex_vec reg_masks;            /* src_mask, dest_mask in the upper half */
+    apex_vec imm;
+} APEX_Batch_Insn;
+
+/* Stage latch of every lane of a group, see CPU_Stage
+ *
+ * Lanes may hold different instructions, so the latch carries the fields of
+ * the instruction instead of a code memory index */
+typedef struct APEX_Batch_Stage
+{
+    APEX_Batch_Insn insn;
+    apex_vec pc;
+    apex_vec rs1_value;
+    apex_vec rs2_value;
+    apex_vec result_buffer;
+    apex_vec memory_address;
+    apex_vec has_insn;             /* Lane mask */
+    apex_vec stage_stalling;       /* Lane mask */
+} APEX_Batch_Stage;
+
+/* Fetch latch of every lane of a group. It holds the code memory index of
+ * the instruction, which is read when the instruction is handed to decode */
+typedef struct APEX_Batch_Fetch
+{
+    apex_vec pc;
+    apex_vec index;
+    apex_vec has_insn;             /* Lane mask */
+    apex_vec stage_stalling;       /* Lane mask */
+} APEX_Batch_Fetch;
+
+/* APEX_BATCH_WIDTH instances in structure of arrays form, see APEX_CPU */
+typedef struct APEX_Batch_Group
+{
+    apex_vec pc;
+    apex_vec insn_completed;
+    apex_vec zero_flag;            /* Lane mask */
+    apex_vec fetch_from_next_cycle; /* Lane mask */
+    apex_vec regs_pending;
+    apex_vec data_forward_valid;
+    apex_vec decode_stall_cycles;
+    apex_vec fetch_stall_cycles;
+    apex_vec live;                 /* Lanes still running */
+    apex_vec status;               /* BATCH_* */
+    apex_vec lane_clock;           /* Cycles run by every lane */
+    apex_vec code_slots;           /* Code memory slots of every lane */
+    apex_vec regs[REG_FILE_SIZE];
+    apex_vec data_forward_buffer[REG_FILE_SIZE];
+    apex_vec data_memory[DATA_MEMORY_SIZE];
+    APEX_Batch_Fetch fetch;
+    APEX_Batch_Stage decode;
+    /* Latches past decode move down the pipeline whole, they rotate
+     * through latch_ring instead of being copied */
+    APEX_Batch_Stage latch_ring[3];
+    APEX_Batch_Stage *execute;
+    APEX_Batch_Stage *memory;
+    APEX_Batch_Stage *writeback;
+    APEX_Batch_Insn *code;         /* Code memory, slots of the longest lane */
+    int clock;
+} APEX_Batch_Group;
+
+struct APEX_Batch
+{
+    int num_instances;
+    int num_groups;
+    const char *const *filenames;  /* Input file of every instance */
+    APEX_Batch_Group *groups;
+};
+
+VEC_INLINE apex_vec
+vec_set1(int value)
+{
+    apex_vec v = {0};
+
+    return v + value;
+}
+
+/* Lanes of a where mask is set, lanes of b elsewhere */
+VEC_INLINE apex_vec
+vec_select(apex_vec mask, apex_vec a, apex_vec b)
+{
+    return (a & mask) | (b & ~mask);
+}
+
+VEC_INLINE int
+vec_any(apex_vec mask)
+{
+    int any = 0;
+    int i;
+
+    for (i = 0; i < APEX_BATCH_WIDTH; i++)
+    {
+        any |= mask[i];
+    }
+    return any != 0;
+}
+
+/*
+ * Returns TRUE when every lane in mask has the same value of v, stored in
+ * value. Lanes running the same code usually agree on the registers and
+ * addresses they use, which turns their accesses into vector ones
+ */
+VEC_INLINE int
+vec_uniform(apex_vec v, apex_vec mask, int *value)
+{
+    int i;
+
+    for (i = 0; i < APEX_BATCH_WIDTH; i++)
+    {
+        if (mask[i])
+        {
+            *value = v[i];
+            return !vec_any(mask & (v != *value));
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Reads table[index] of the lanes in mask, lane i of the vector picked by
+ * lane i of index. Other lanes read 0
+ */
+VEC_INLINE apex_vec
+vec_gather(const apex_vec *table, apex_vec index, apex_vec mask)
+{
+    apex_vec v = {0};
+    int uniform;
+    int i;
+
+    if (vec_uniform(index, mask, &uniform))
+    {
+        return table[uniform] & mask;
+    }
+    for (i = 0; i < APEX_BATCH_WIDTH; i++)
+    {
+        if (mask[i])
+        {
+            v[i] = table[index[i]][i];
+        }
+    }
+    return v;
+}
+
+/* Writes table[index] of the lanes in mask, see vec_gather */
+VEC_INLINE void
+vec_scatter(apex_vec *table, apex_vec index, apex_vec value, apex_vec mask)
+{
+    int uniform;
+    int i;
+
+    if (vec_uniform(index, mask, &uniform))
+    {
+        table[uniform] = vec_select(mask, value, table[uniform]);
+        return;
+    }
+    for (i = 0; i < APEX_BATCH_WIDTH; i++)
+    {
+        if (mask[i])
+        {
+            table[index[i]][i] = value[i];
+        }
+    }
+}
+
+VEC_INLINE apex_vec
+insn_opcode(const APEX_Batch_Insn *insn)
+{
+    return insn->fields & FIELD_OPCODE_MASK;
+}
+
+VEC_INLINE apex_vec
+insn_rd(const APEX_Batch_Insn *insn)
+{
+    return (insn->fields >> FIELD_RD_SHIFT) & FIELD_REG_MASK;
+}
+
+VEC_INLINE apex_vec
+insn_rs1(const APEX_Batch_Insn *insn)
+{
+    return (insn->fields >> FIELD_RS1_SHIFT) & FIELD_REG_MASK;
+}
+
+VEC_INLINE apex_vec
+insn_rs2(const APEX_Batch_Insn *insn)
+{
+    return (insn->fields >> FIELD_RS2_SHIFT) & FIELD_REG_MASK;
+}
+
+/* Lanes whose instruction has any of the INSN_* flags */
+VEC_INLINE apex_vec
+insn_has_flags(const APEX_Batch_Insn *insn, int flags)
+{
+    return (insn->fields & (flags << FIELD_FLAGS_SHIFT)) != 0;
+}
+
+VEC_INLINE apex_vec
+insn_src_mask(const APEX_Batch_Insn *insn)
+{
+    return insn->reg_masks & 0xffff;
+}
+
+VEC_INLINE apex_vec
+insn_dest_mask(const APEX_Batch_Insn *insn)
+{
+    return (insn->reg_masks >> 16) & 0xffff;
+}
+
+/* Ends the lanes in mask, they keep their state for the report */
+VEC_INLINE void
+finish_lanes(APEX_Batch_Group *group, apex_vec mask, int status)
+{
+    group->status = vec_select(mask, vec_set1(status), group->status);
+    group->live &= ~mask;
+}
+
+/* Lanes in mask whose data memory address is out of range fault, returns
+ * the others */
+VEC_INLINE apex_vec
+check_data_address(APEX_Batch_Group *group, apex_vec address, apex_vec mask)
+{
+    apex_vec bad;
+
+    bad = mask & ((address < 0) | (address >= DATA_MEMORY_SIZE));
+    finish_lanes(group, bad, BATCH_FAULTED);
+    return mask & ~bad;
+}
+
+/* See forward_result */
+VEC_INLINE void
+forward_results(APEX_Batch_Group *group, apex_vec mask, apex_vec rd,
+                apex_vec value)
+{
+#if APEX_FORWARDING
+    if (vec_any(mask))
+    {
+        vec_scatter(group->data_forward_buffer, rd, value, mask);
+        group->data_forward_valid |= (vec_set1(1) << rd) & mask;
+    }
+#endif
+}
+
+/* See unavailable_regs */
+VEC_INLINE apex_vec
+unavailable_lane_regs(const APEX_Batch_Group *group)
+{
+#if APEX_FORWARDING
+    return ~group->data_forward_valid;
+#else
+    return group->regs_pending;
+#endif
+}
+
+/*
+ * Writeback, see APEX_writeback. Lanes retiring HALT end here
+ */
+VEC_INLINE void
+batch_writeback(APEX_Batch_Group *group)
+{
+    const APEX_Batch_Stage *wb = group->writeback;
+    apex_vec active = wb->has_insn & group->live;
+    apex_vec dest_mask = insn_dest_mask(&wb->insn) & active;
+
+    if (vec_any(dest_mask))
+    {
+        vec_scatter(group->regs, insn_rd(&wb->insn), wb->result_buffer,
+                    dest_mask != 0);
+        group->regs_pending &= ~dest_mask;
+    }
+    group->insn_completed -= active;
+
+    finish_lanes(group, active & insn_has_flags(&wb->insn, INSN_HALT),
+                 BATCH_HALTED);
+}
+
+/*
+ * Memory, see APEX_memory. The latch becomes the writeback latch
+ */
+VEC_INLINE void
+batch_memory(APEX_Batch_Group *group)
+{
+    APEX_Batch_Stage *mem = group->memory;
+    apex_vec active = mem->has_insn & group->live;
+    apex_vec loads = active & insn_has_flags(&mem->insn, INSN_LOAD);
+    apex_vec stores = active & insn_has_flags(&mem->insn, INSN_STORE);
+    apex_vec value;
+
+    if (vec_any(loads | stores))
+    {
+        loads = check_data_address(group, mem->memory_address, loads);
+        stores = check_data_address(group, mem->memory_address, stores);
+
+        value = vec_gather(group->data_memory, mem->memory_address, loads);
+        mem->result_buffer = vec_select(loads, value, mem->result_buffer);
+        forward_results(group, loads, insn_rd(&mem->insn), value);
+
+        /* STORE and STR read their data register here */
+        if (vec_any(stores))
+        {
+            vec_scatter(group->data_memory, mem->memory_address,
+                        vec_gather(group->regs, insn_rd(&mem->insn), stores),
+                        stores);
+        }
+    }
+    mem->has_insn = active & group->live;
+}
+
+/*
+ * Execute, see APEX_execute. The latch becomes the memory latch. Every lane
+ * computes each result its opcode may need and keeps the one of its opcode
+ */
+VEC_INLINE void
+batch_execute(APEX_Batch_Group *group)
+{
+    APEX_Batch_Stage *ex = group->execute;
+    apex_vec active = ex->has_insn & group->live;
+    apex_vec opcode = insn_opcode(&ex->insn);
+    apex_vec a = ex->rs1_value;
+    apex_vec b = ex->rs2_value;
+    apex_vec imm = ex->insn.imm;
+    apex_vec result = ex->result_buffer;
+    apex_vec divides, loads, produces, sets_zero, taken;
+    int i;
+
+    result = vec_select(opcode == OPCODE_ADD, a + b, result);
+    result = vec_select(opcode == OPCODE_SUB, a - b, result);
+    result = vec_select(opcode == OPCODE_MUL, a * b, result);
+    result = vec_select(opcode == OPCODE_AND, a & b, result);
+    result = vec_select(opcode == OPCODE_OR, a | b, result);
+    result = vec_select(opcode == OPCODE_XOR, a ^ b, result);
+    result = vec_select(opcode == OPCODE_ADDL, a + imm, result);
+    result = vec_select(opcode == OPCODE_SUBL, a - imm, result);
+    result = vec_select(opcode == OPCODE_MOVC, imm, result);
+
+    /* No vector divide, and a lane that would trap faults instead */
+    divides = active & (opcode == OPCODE_DIV);
+    if (vec_any(divides))
+    {
+        finish_lanes(group,
+                     divides & ((b == 0) | ((a == INT_MIN) & (b == -1))),
+                     BATCH_FAULTED);
+        divides &= group->live;
+        for (i = 0; i < APEX_BATCH_WIDTH; i++)
+        {
+            if (divides[i])
+            {
+                result[i] = a[i] / b[i];
+            }
+        }
+        active &= group->live;
+    }
+
+    loads = active & insn_has_flags(&ex->insn, INSN_LOAD);
+    produces = active & (insn_dest_mask(&ex->insn) != 0) & ~loads;
+    ex->result_buffer = vec_select(produces, result, ex->result_buffer);
+    forward_results(group, produces, insn_rd(&ex->insn), result);
+
+    sets_zero = active & insn_has_flags(&ex->insn, INSN_SETS_ZERO_FLAG);
+    group->zero_flag = vec_select(
+        sets_zero,
+        vec_select(opcode == OPCODE_CMP, a == b, result == 0),
+        group->zero_flag);
+
+    ex->memory_address = vec_select(
+        (opcode == OPCODE_STR) | (opcode == OPCODE_LDR), a + b, a + imm);
+#if APEX_FORWARDING
+    /* The forwarding pipeline hands the loaded word to decode from here */
+    if (vec_any(loads))
+    {
+        loads = check_data_address(group, ex->memory_address, loads);
+        forward_results(group, loads, insn_rd(&ex->insn),
+                        vec_gather(group->data_memory, ex->memory_address,
+                                   loads));
+        active &= group->live;
+    }
+#endif
+
+    /* CMP continues into the BZ redirect */
+    taken = active & insn_has_flags(&ex->insn, INSN_BRANCH)
+            & vec_select(opcode == OPCODE_BNZ, ~group->zero_flag,
+                         group->zero_flag);
+    group->pc = vec_select(taken, ex->pc + imm, group->pc);
+    group->fetch_from_next_cycle |= taken;
+    group->fetch.has_insn |= taken;
+
+    ex->has_insn = active;
+}
+
+/*
+ * Decode, see APEX_decode. The execute latch of the next cycle is the one
+ * writeback is done with
+ */
+VEC_INLINE void
+batch_decode(APEX_Batch_Group *group)
+{
+    APEX_Batch_Stage *decode = &group->decode;
+    APEX_Batch_Stage *execute = group->writeback;
+    apex_vec active = decode->has_insn & group->live
+                      & ~group->fetch_from_next_cycle;
+    apex_vec src_mask = insn_src_mask(&decode->insn);
+    apex_vec stalled = active & ((src_mask & unavailable_lane_regs(group)) != 0);
+    apex_vec issued = active & ~stalled;
+    apex_vec reads = issued & (src_mask != 0);
+    apex_vec advance;
+
+    if (vec_any(reads))
+    {
+#if APEX_FORWARDING
+        decode->rs1_value = vec_select(
+            reads,
+            vec_select(insn_opcode(&decode->insn) == OPCODE_STORE,
+                       (group->data_forward_valid >> insn_rs1(&decode->insn))
+                           & 1,
+                       vec_gather(group->data_forward_buffer,
+                                  insn_rs1(&decode->insn), reads)),
+            decode->rs1_value);
+        decode->rs2_value = vec_select(
+            reads,
+            vec_gather(group->data_forward_buffer, insn_rs2(&decode->insn),
+                       reads),
+            decode->rs2_value);
+#else
+        decode->rs1_value = vec_select(
+            reads, vec_gather(group->regs, insn_rs1(&decode->insn), reads),
+            decode->rs1_value);
+        decode->rs2_value = vec_select(
+            reads, vec_gather(group->regs, insn_rs2(&decode->insn), reads),
+            decode->rs2_value);
+#endif
+    }
+
+    /* Instructions without source registers leave the stall state alone */
+    decode->stage_stalling = vec_select(
+        stalled, vec_set1(-1),
+        vec_select(reads, vec_set1(0), decode->stage_stalling));
+    group->fetch.stage_stalling = vec_select(
+        stalled, vec_set1(-1),
+        vec_select(reads, vec_set1(0), group->fetch.stage_stalling));
+    group->regs_pending |= insn_dest_mask(&decode->insn) & issued;
+
+    /* Only what execute and the later stages read */
+    advance = active & ~decode->stage_stalling;
+    execute->insn = decode->insn;
+    execute->pc = decode->pc;
+    execute->rs1_value = decode->rs1_value;
+    execute->rs2_value = decode->rs2_value;
+    execute->has_insn = advance;
+    decode->has_insn = active & ~advance;
+    group->decode_stall_cycles -= active & decode->stage_stalling;
+}
+
+/* Hands the instruction in the fetch latch to decode in the lanes in mask */
+VEC_INLINE void
+hand_off_to_decode(APEX_Batch_Group *group, apex_vec mask)
+{
+    APEX_Batch_Stage *decode = &group->decode;
+    const APEX_Batch_Insn *code = group->code;
+    apex_vec index = group->fetch.index;
+    APEX_Batch_Insn insn;
+    int uniform;
+    int i;
+
+    if (vec_uniform(index, mask, &uniform))
+    {
+        insn = code[uniform];
+    }
+    else
+    {
+        for (i = 0; i < APEX_BATCH_WIDTH; i++)
+        {
+            if (mask[i])
+            {
+                insn.fields[i] = code[index[i]].fields[i];
+                insn.reg_masks[i] = code[index[i]].reg_masks[i];
+                insn.imm[i] = code[index[i]].imm[i];
+            }
+        }
+    }
+
+    decode->insn.fields = vec_select(mask, insn.fields, decode->insn.fields);
+    decode->insn.reg_masks = vec_select(mask, insn.reg_masks,
+                                        decode->insn.reg_masks);
+    decode->insn.imm = vec_select(mask, insn.imm, decode->insn.imm);
+    decode->pc = vec_select(mask, group->fetch.pc, decode->pc);
+    decode->stage_stalling = vec_select(mask, group->fetch.stage_stalling,
+                                        decode->stage_stalling);
+    decode->has_insn |= mask;
+}
+
+/*
+ * Fetch, see APEX_fetch
+ */
+VEC_INLINE void
+batch_fetch(APEX_Batch_Group *group)
+{
+    APEX_Batch_Fetch *fetch = &group->fetch;
+    apex_vec live = group->live;
+    apex_vec skip, fetched, hand_off, bad, index;
+#if !APEX_FORWARDING
+    apex_vec resume;
+#endif
+
+#if APEX_FORWARDING
+    /* Fetch does not wait for a stalled decode */
+    fetched = live & fetch->has_insn;
+    group->fetch_stall_cycles -= live & ~fetch->has_insn;
+#else
+    fetched = live & fetch->has_insn;
+    resume = live & ~fetch->has_insn & ~fetch->stage_stalling;
+    group->fetch_stall_cycles -= live & ~fetch->has_insn
+                                 & fetch->stage_stalling;
+#endif
+
+    /* This fetches new branch target instruction from next cycle */
+    skip = fetched & group->fetch_from_next_cycle;
+    group->fetch_from_next_cycle &= ~skip;
+    group->fetch_stall_cycles -= skip;
+    fetched &= ~skip;
+
+    if (vec_any(fetched))
+    {
+        index = (group->pc - 4000) >> 2;
+        bad = fetched & ((index < 0) | (index >= group->code_slots));
+        finish_lanes(group, bad, BATCH_FAULTED);
+        fetched &= ~bad;
+
+        fetch->pc = vec_select(fetched, group->pc, fetch->pc);
+        fetch->index = vec_select(fetched, index, fetch->index);
+
+#if APEX_FORWARDING
+        hand_off = fetched;
+#else
+        /* A stalled decode gets the instruction once the stall clears */
+        hand_off = fetched & ~fetch->stage_stalling;
+        fetch->has_insn &= ~(fetched & fetch->stage_stalling);
+        group->fetch_stall_cycles -= fetched & fetch->stage_stalling;
+#endif
+        group->pc += hand_off & 4;
+        hand_off_to_decode(group, hand_off);
+
+        /* Stop fetching new instructions if HALT is fetched */
+        fetch->has_insn &= ~(hand_off
+                             & insn_has_flags(&group->decode.insn, INSN_HALT));
+    }
+
+#if !APEX_FORWARDING
+    if (vec_any(resume))
+    {
+        fetch->has_insn |= resume;
+        hand_off_to_decode(group, resume);
+        group->pc += resume & 4;
+    }
+#endif
+}
+
+/*
+ * Returns the lanes in which no latch can change any more, see
+ * pipeline_quiescent
+ */
+VEC_INLINE apex_vec
+batch_quiescent(const APEX_Batch_Group *group)
+{
+    const APEX_Batch_Stage *decode = &group->decode;
+    apex_vec src_mask = insn_src_mask(&decode->insn);
+    apex_vec quiescent;
+
+    quiescent = ~group->execute->has_insn & ~group->memory->has_insn
+                & ~group->writeback->has_insn & ~group->fetch_from_next_cycle;
+    quiescent &= ~decode->has_insn
+                 | ((src_mask & unavailable_lane_regs(group)) != 0)
+                 | ((src_mask == 0) & decode->stage_stalling);
+#if APEX_FORWARDING
+    quiescent &= ~group->fetch.has_insn;
+#else
+    quiescent &= ~group->fetch.has_insn & group->fetch.stage_stalling;
+#endif
+    return quiescent & group->live;
+}
+
+/*
+ * Runs the lanes of a group until all of them have ended, or for at most
+ * max_cycles. Stages go from writeback to fetch as in APEX_cpu_run, which
+ * lets every stage update its latch in place
+ */
+BATCH_KERNEL static void
+batch_run_group(APEX_Batch_Group *group, int max_cycles)
+{
+    APEX_Batch_Stage *latch;
+
+    while (vec_any(group->live) && group->clock < max_cycles)
+    {
+        batch_writeback(group);
+        batch_memory(group);
+        batch_execute(group);
+        batch_decode(group);
+        batch_fetch(group);
+        group->clock++;
+        group->lane_clock -= group->live;
+
+        latch = group->writeback;
+        group->writeback = group->memory;
+        group->memory = group->execute;
+        group->execute = latch;
+
+        if (ENABLE_CYCLE_SKIPPING)
+        {
+            finish_lanes(group, batch_quiescent(group), BATCH_DEADLOCKED);
+        }
+    }
+    finish_lanes(group, group->live, BATCH_STOPPED);
+}
+
+/*
+ * Loads the program of every instance, instance i runs in lane
+ * i % APEX_BATCH_WIDTH of group i / APEX_BATCH_WIDTH
+ */
+APEX_Batch *
+APEX_batch_init(const char *const *filenames, int num_instances)
+{
+    APEX_Batch *batch;
+    APEX_Batch_Group *group;
+    APEX_Instruction *code_memory[APEX_BATCH_WIDTH];
+    const APEX_Instruction *insn;
+    APEX_Insn_Deps *code_deps[APEX_BATCH_WIDTH];
+    int size[APEX_BATCH_WIDTH];
+    APEX_Memory data_memory;
+    size_t bytes;
+    int slots, lanes, lane;
+    int g, s, r;
+
+    batch = calloc(1, sizeof(APEX_Batch));
+    if (!batch)
+    {
+        return NULL;
+    }
+    batch->num_instances = num_instances;
+    batch->filenames = filenames;
+
+    bytes = ((num_instances + APEX_BATCH_WIDTH - 1) / APEX_BATCH_WIDTH)
+            * sizeof(APEX_Batch_Group);
+    batch->groups = aligned_alloc(CODE_MEMORY_ALIGN,
+                                  (bytes + CODE_MEMORY_ALIGN - 1)
+                                      & ~(size_t)(CODE_MEMORY_ALIGN - 1));
+    if (!batch->groups)
+    {
+        free(batch);
+        return NULL;
+    }
+    memset(batch->groups, 0, bytes);
+
+    for (g = 0; g * APEX_BATCH_WIDTH < num_instances; g++)
+    {
+        group = &batch->groups[g];
+        batch->num_groups = g + 1;
+        group->pc = vec_set1(4000);
+        group->execute = &group->latch_ring[0];
+        group->memory = &group->latch_ring[1];
+        group->writeback = &group->latch_ring[2];
+
+        /* To start fetch stage */
+        group->fetch.has_insn = vec_set1(-1);
+
+        lanes = num_instances - g * APEX_BATCH_WIDTH;
+        if (lanes > APEX_BATCH_WIDTH)
+        {
+            lanes = APEX_BATCH_WIDTH;
+        }
+
+        /* Parse the programs of the group, code memory has the slots of the
+         * longest one */
+        slots = 0;
+        for (lane = 0; lane < lanes; lane++)
+        {
+            APEX_memory_init(&data_memory, FALSE);
+            code_memory[lane] = create_code_memory(
+                filenames[g * APEX_BATCH_WIDTH + lane], &size[lane], NULL,
+                &data_memory);
+            code_deps[lane] = NULL;
+            if (code_memory[lane])
+            {
+                code_deps[lane] = create_insn_deps(code_memory[lane],
+                                                   size[lane], NULL);
+            }
+            if (!code_deps[lane])
+            {
+                fprintf(stderr, "APEX_Error: Unable to load %s\n",
+                        filenames[g * APEX_BATCH_WIDTH + lane]);
+                free(code_memory[lane]);
+                APEX_memory_free(&data_memory);
+                break;
+            }
+            if (size[lane] + CODE_MEMORY_PADDING > slots)
+            {
+                slots = size[lane] + CODE_MEMORY_PADDING;
+            }
+
+            /* Binary images come with initial data memory, lanes only
+             * have the words the final state shows */
+            for (r = 0; r < DATA_MEMORY_SIZE; r++)
+            {
+                group->data_memory[r][lane] = APEX_memory_peek(&data_memory, r);
+            }
+            APEX_memory_free(&data_memory);
+        }
+
+        bytes = slots * sizeof(APEX_Batch_Insn);
+        if (lane == lanes)
+        {
+            group->code = aligned_alloc(CODE_MEMORY_ALIGN,
+                                        (bytes + CODE_MEMORY_ALIGN - 1)
+                                            & ~(size_t)(CODE_MEMORY_ALIGN - 1));
+        }
+        if (group->code)
+        {
+            memset(group->code, 0, bytes);
+        }
+
+        /* Lanes past the last instance stay dead */
+        while (lane-- > 0)
+        {
+            for (s = 0; group->code && s < size[lane] + CODE_MEMORY_PADDING; s++)
+            {
+                insn = &code_memory[lane][s];
+                group->code[s].fields[lane] =
+                    insn->opcode | (insn->rd & FIELD_REG_MASK) << FIELD_RD_SHIFT
+                    | (insn->rs1 & FIELD_REG_MASK) << FIELD_RS1_SHIFT
+                    | (insn->rs2 & FIELD_REG_MASK) << FIELD_RS2_SHIFT
+                    | code_deps[lane][s].flags << FIELD_FLAGS_SHIFT;
+                group->code[s].reg_masks[lane] =
+                    code_deps[lane][s].src_mask
+                    | (unsigned int)code_deps[lane][s].dest_mask << 16;
+                group->code[s].imm[lane] = insn->imm;
+            }
+            group->code_slots[lane] = size[lane] + CODE_MEMORY_PADDING;
+            group->live[lane] = -1;
+
+            free(code_deps[lane]);
+            free(code_memory[lane]);
+        }
+
+        if (!group->code)
+        {
+            APEX_batch_stop(batch);
+            return NULL;
+        }
+    }
+
+    return batch;
+}
+
+/*
+ * Runs every instance until it halts, deadlocks, faults or reaches
+ * max_cycles
+ */
+void
+APEX_batch_run(APEX_Batch *batch, int max_cycles)
+{
+    int g;
+
+    for (g = 0; g < batch->num_groups; g++)
+    {
+        batch_run_group(&batch->groups[g], max_cycles);
+    }
+}
+
+/*
+ * Prints how every instance ended and its architectural state, in the
+ * format of a simulate run
+ */
+void
+APEX_batch_report(const APEX_Batch *batch)
+{
+    static const char *const endings[] = {
+        [BATCH_HALTED] = "Complete",
+        [BATCH_DEADLOCKED] = "Deadlocked",
+        [BATCH_STOPPED] = "Stopped",
+        [BATCH_FAULTED] = "Faulted",
+    };
+    const APEX_Batch_Group *group;
+    APEX_CPU *cpu;
+    int i, lane, r;
+
+    /* Lane state is copied into a CPU to print it */
+    cpu = calloc(1, sizeof(APEX_CPU));
+    if (!cpu)
+    {
+        return;
+    }
+    APEX_memory_init(&cpu->data_memory, FALSE);
+
+    for (i = 0; i < batch->num_instances; i++)
+    {
+        group = &batch->groups[i / APEX_BATCH_WIDTH];
+        lane = i % APEX_BATCH_WIDTH;
+
+        for (r = 0; r < REG_FILE_SIZE; r++)
+        {
+            cpu->regs[r] = group->regs[r][lane];
+        }
+        for (r = 0; r < DATA_MEMORY_SIZE; r++)
+        {
+            APEX_memory_store(&cpu->data_memory, r,
+                              group->data_memory[r][lane]);
+        }
+        cpu->regs_pending = group->regs_pending[lane];
+
+        printf("APEX_BATCH: Instance %d, %s\n", i, batch->filenames[i]);
+        printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+               endings[group->status[lane]], group->lane_clock[lane],
+               group->insn_completed[lane]);
+        APEX_cpu_display_state(cpu);
+    }
+
+    APEX_memory_free(&cpu->data_memory);
+    free(cpu);
+}
+
+void
+APEX_batch_stop(APEX_Batch *batch)
+{
+    int g;
+
+    for (g = 0; g < batch->num_groups; g++)
+    {
+        free(batch->groups[g].code);
+    }
+    free(batch->groups);
+    free(batch);
+}
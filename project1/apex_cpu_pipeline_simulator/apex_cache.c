@@ -0,0 +1,292 @@
+/*
+ * apex_cache.c
+ * Contains the result cache: a directory of finished runs, each in a file
+ * named after a hash of everything the run depends on, its key. The key
+ * covers code memory, the state the CPU starts in, data memory included,
+ * and the options that change what is simulated. A run whose key is in the
+ * cache takes its result and final state from there instead of being
+ * simulated.
+ *
+ * Entries are written to a file of their own in the directory and renamed
+ * into place, so any number of processes can share a cache: a reader sees
+ * a whole entry or none, and of two processes writing the same entry
+ * either one wins
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Start of a cache entry, followed by the final state as a dump */
+typedef struct APEX_Cache_Entry
+{
+    char magic[8];                 /* APEX_CACHE_MAGIC */
+    unsigned int version;          /* APEX_CACHE_VERSION */
+    int run_status;                /* RUN_HALTED or RUN_DEADLOCKED */
+    unsigned long long key[2];     /* Must be that of the file name */
+    int decode_stall_cycles;
+    int fetch_stall_cycles;
+} APEX_Cache_Entry;
+
+/*
+ * Adds size bytes at data to the two halves of hash, eight at a time. Each
+ * half multiplies by its own odd constant and folds the high bits back
+ * down, so that every bit of the input reaches every bit of the key
+ */
+static void
+hash_bytes(unsigned long long hash[2], const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    unsigned long long word;
+    size_t n;
+
+    while (size > 0)
+    {
+        n = size < sizeof(word) ? size : sizeof(word);
+        word = 0;
+        memcpy(&word, bytes, n);
+        hash[0] = (hash[0] ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash[0] ^= hash[0] >> 29;
+        hash[1] = (hash[1] ^ word) * 0xff51afd7ed558ccdULL;
+        hash[1] ^= hash[1] >> 33;
+        bytes += n;
+        size -= n;
+    }
+}
+
+static void
+hash_int(unsigned long long hash[2], int value)
+{
+    hash_bytes(hash, &value, sizeof(value));
+}
+
+/*
+ * Works out the key of the run cpu is about to start, leaving code memory
+ * out unless with_code
+ */
+void
+APEX_cache_key(const APEX_CPU *cpu, int with_code, unsigned long long key[2])
+{
+    static const int zeros[DATA_PAGE_WORDS];
+    const int *words;
+    unsigned int page;
+
+    key[0] = 0xcbf29ce484222325ULL;
+    key[1] = 0x84222325cbf29ce4ULL;
+
+    /* What the results depend on besides the run: the simulator and the
+     * pipeline variant. The trace variants give the same results */
+    hash_int(key, APEX_CACHE_VERSION);
+    hash_int(key, (int)(VERSION * 10));
+    hash_int(key, APEX_FORWARDING);
+
+    if (with_code)
+    {
+        hash_int(key, cpu->code_memory_slots);
+        hash_bytes(key, cpu->code_memory,
+                   cpu->code_memory_slots * sizeof(APEX_Instruction));
+    }
+
+    hash_int(key, cpu->pc);
+    hash_bytes(key, cpu->regs, sizeof(cpu->regs));
+    hash_int(key, cpu->regs_pending);
+    hash_int(key, cpu->zero_flag);
+
+    /* Pages of zeros are left out, memory reads the same with or without
+     * them mapped in */
+    for (page = APEX_memory_next_page(&cpu->data_memory, 0);
+         page != DATA_NO_PAGE;
+         page = APEX_memory_next_page(&cpu->data_memory, page + 1))
+    {
+        words = APEX_memory_page(&cpu->data_memory, page);
+        if (memcmp(words, zeros, sizeof(zeros)) != 0)
+        {
+            hash_int(key, page);
+            hash_bytes(key, words, sizeof(zeros));
+        }
+    }
+    hash_int(key, DATA_NO_PAGE);
+
+    /* Options changing what is simulated, the others only change what is
+     * printed of it */
+    hash_int(key, cpu->cycle_limit);
+    hash_int(key, cpu->fast_forward_insns);
+    hash_int(key, cpu->fast_forward_pc);
+    hash_int(key, cpu->jit_enabled);
+    hash_int(key, cpu->decoupled);
+    hash_int(key, cpu->cycle_skipping);
+}
+
+/*
+ * Puts the file name of the entry with key into path.
+ *
+ * Returns FALSE if it does not fit
+ */
+static int
+entry_path(const APEX_CPU *cpu, const unsigned long long key[2], char *path,
+           size_t size)
+{
+    return snprintf(path, size, "%s/%016llx%016llx", cpu->cache_dir, key[0],
+                    key[1])
+           < (int)size;
+}
+
+/*
+ * Returns TRUE if the run of cpu can be taken from the cache: one starting
+ * from the beginning, of which nothing but the result and the final state
+ * is printed or saved
+ */
+static int
+cacheable(const APEX_CPU *cpu)
+{
+    return cpu->cache_dir && !cpu->debug_messages && !cpu->snapshot_file
+           && cpu->sample_period == 0 && cpu->interval_insns == 0
+           && cpu->clock == 0 && cpu->insn_completed == 0;
+}
+
+/*
+ * Looks the run cpu is about to start up in the cache. The key is kept in
+ * cpu for APEX_cache_store.
+ *
+ * Returns TRUE if it was found, cpu being left in its final state with
+ * run_status set, FALSE if it is to be simulated
+ */
+int
+APEX_cache_lookup(APEX_CPU *cpu)
+{
+    const APEX_Cache_Entry *entry;
+    char path[4096];
+    struct stat st;
+    void *data;
+    int found;
+    int fd;
+
+    cpu->cache_keyed = FALSE;
+    if (!cacheable(cpu))
+    {
+        return FALSE;
+    }
+    APEX_cache_key(cpu, TRUE, cpu->cache_key);
+    cpu->cache_keyed = TRUE;
+
+    if (!entry_path(cpu, cpu->cache_key, path, sizeof(path)))
+    {
+        return FALSE;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return FALSE;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(APEX_Cache_Entry))
+    {
+        close(fd);
+        return FALSE;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return FALSE;
+    }
+
+    entry = data;
+    found = memcmp(entry->magic, APEX_CACHE_MAGIC, sizeof(APEX_CACHE_MAGIC))
+                == 0
+            && entry->version == APEX_CACHE_VERSION
+            && entry->key[0] == cpu->cache_key[0]
+            && entry->key[1] == cpu->cache_key[1]
+            && (entry->run_status == RUN_HALTED
+                || entry->run_status == RUN_DEADLOCKED)
+            && APEX_dump_apply(cpu, entry + 1, st.st_size - sizeof(*entry));
+    if (found)
+    {
+        cpu->run_status = entry->run_status;
+        cpu->decode_stall_cycles = entry->decode_stall_cycles;
+        cpu->fetch_stall_cycles = entry->fetch_stall_cycles;
+    }
+    else
+    {
+        fprintf(stderr, "APEX_Error: Ignoring bad cache entry %s\n", path);
+    }
+    munmap(data, st.st_size);
+    return found;
+}
+
+/*
+ * Adds the run of cpu, which APEX_cache_lookup did not find, to the cache
+ * if it ran to its end. Failing to is reported, the run is not affected
+ */
+void
+APEX_cache_store(const APEX_CPU *cpu)
+{
+    APEX_Cache_Entry entry;
+    char path[4096];
+    char temp[4096];
+    FILE *fp = NULL;
+    int written;
+    int fd;
+
+    if (!cpu->cache_keyed
+        || (cpu->run_status != RUN_HALTED && cpu->run_status != RUN_DEADLOCKED))
+    {
+        return;
+    }
+
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.magic, APEX_CACHE_MAGIC, sizeof(APEX_CACHE_MAGIC));
+    entry.version = APEX_CACHE_VERSION;
+    entry.run_status = cpu->run_status;
+    entry.key[0] = cpu->cache_key[0];
+    entry.key[1] = cpu->cache_key[1];
+    entry.decode_stall_cycles = cpu->decode_stall_cycles;
+    entry.fetch_stall_cycles = cpu->fetch_stall_cycles;
+
+    if (mkdir(cpu->cache_dir, 0777) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "APEX_Error: Unable to create cache %s\n",
+                cpu->cache_dir);
+        return;
+    }
+    if (!entry_path(cpu, cpu->cache_key, path, sizeof(path))
+        || snprintf(temp, sizeof(temp), "%s.XXXXXX", path)
+               >= (int)sizeof(temp))
+    {
+        fprintf(stderr, "APEX_Error: Cache directory name too long\n");
+        return;
+    }
+
+    /* A temporary name of its own, so that writers never share a file */
+    fd = mkstemp(temp);
+    if (fd < 0 || fchmod(fd, 0644) != 0 || !(fp = fdopen(fd, "wb")))
+    {
+        fprintf(stderr, "APEX_Error: Unable to write cache entry %s\n", path);
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(temp);
+        }
+        return;
+    }
+
+    /* On disk before it is renamed into place */
+    written = fwrite(&entry, sizeof(entry), 1, fp) == 1
+              && APEX_dump_write(cpu, fp) && fflush(fp) == 0
+              && fsync(fd) == 0;
+    if (fclose(fp) != 0 || !written || rename(temp, path) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write cache entry %s\n", path);
+        unlink(temp);
+    }
+}
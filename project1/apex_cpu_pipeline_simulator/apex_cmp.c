@@ -0,0 +1,253 @@
+/*
+ * apex_cmp.c
+ * Contains the dump comparer, which tells whether two final-state dumps
+ * written by the dump option hold the same architectural state, and prints
+ * what differs. Both dumps are mapped in and their pages compared whole
+ * before any word is looked at, so equal memory costs a memcmp per page.
+ *
+ * Exits with 0 if the dumps are the same, 1 if they differ, 2 on error
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Differences printed unless the limit is given */
+#define CMP_MAX_DIFFS 20
+
+/* Dump mapped in */
+typedef struct APEX_Dump
+{
+    const char *filename;
+    const APEX_Dump_Header *header;
+    const APEX_Dump_Page *pages;
+    size_t size;
+} APEX_Dump;
+
+/* Differences found so far, and how many of them to print */
+typedef struct APEX_Cmp
+{
+    long diffs;
+    long max_diffs;
+} APEX_Cmp;
+
+/*
+ * Maps filename into dump and checks it is a whole dump of this version
+ *
+ * Returns FALSE if it is not
+ */
+static int
+map_dump(APEX_Dump *dump, const char *filename)
+{
+    struct stat st;
+    void *data;
+    int fd;
+
+    dump->filename = filename;
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open %s\n", filename);
+        return FALSE;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(APEX_Dump_Header))
+    {
+        fprintf(stderr, "APEX_Error: %s is not a dump\n", filename);
+        close(fd);
+        return FALSE;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "APEX_Error: Unable to map %s\n", filename);
+        return FALSE;
+    }
+
+    dump->header = data;
+    dump->pages = (const APEX_Dump_Page *)(dump->header + 1);
+    dump->size = st.st_size;
+    if (memcmp(dump->header->magic, APEX_DUMP_MAGIC, sizeof(APEX_DUMP_MAGIC))
+            != 0
+        || dump->header->version != APEX_DUMP_VERSION
+        || dump->header->num_pages > DATA_NUM_PAGES
+        || dump->size != sizeof(APEX_Dump_Header)
+                             + dump->header->num_pages
+                                   * sizeof(APEX_Dump_Page))
+    {
+        fprintf(stderr, "APEX_Error: %s is not a version %d dump\n", filename,
+                APEX_DUMP_VERSION);
+        munmap(data, dump->size);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Counts a difference of what, what[index] unless index is negative,
+ * printing it while under the limit
+ */
+static void
+report(APEX_Cmp *cmp, const char *what, long long index, int a, int b)
+{
+    if (cmp->diffs++ >= cmp->max_diffs)
+    {
+        return;
+    }
+    if (index >= 0)
+    {
+        printf("APEX_CMP: %s[%lld] %d != %d\n", what, index, a, b);
+    }
+    else
+    {
+        printf("APEX_CMP: %s %d != %d\n", what, a, b);
+    }
+}
+
+/*
+ * Compares the registers and zero flag of the two dumps
+ */
+static void
+compare_registers(APEX_Cmp *cmp, const APEX_Dump_Header *a,
+                  const APEX_Dump_Header *b)
+{
+    int i;
+
+    for (i = 0; i < REG_FILE_SIZE; i++)
+    {
+        if (a->regs[i] != b->regs[i])
+        {
+            report(cmp, "REG", i, a->regs[i], b->regs[i]);
+        }
+    }
+    if (a->zero_flag != b->zero_flag)
+    {
+        report(cmp, "Z_FLAG", -1, a->zero_flag, b->zero_flag);
+    }
+}
+
+/*
+ * Compares data memory page by page, a page missing from one dump holding
+ * zeros there
+ */
+static void
+compare_memory(APEX_Cmp *cmp, const APEX_Dump *a, const APEX_Dump *b)
+{
+    static const int zeros[DATA_PAGE_WORDS];
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int page;
+    const int *wa;
+    const int *wb;
+    int k;
+
+    /* Both dumps list their pages by increasing number */
+    while (i < a->header->num_pages || j < b->header->num_pages)
+    {
+        page = DATA_NO_PAGE;
+        if (i < a->header->num_pages)
+        {
+            page = a->pages[i].page;
+        }
+        if (j < b->header->num_pages && b->pages[j].page < page)
+        {
+            page = b->pages[j].page;
+        }
+
+        wa = zeros;
+        wb = zeros;
+        if (i < a->header->num_pages && a->pages[i].page == page)
+        {
+            wa = a->pages[i++].words;
+        }
+        if (j < b->header->num_pages && b->pages[j].page == page)
+        {
+            wb = b->pages[j++].words;
+        }
+
+        if (memcmp(wa, wb, sizeof(zeros)) == 0)
+        {
+            continue;
+        }
+        for (k = 0; k < DATA_PAGE_WORDS; k++)
+        {
+            if (wa[k] != wb[k])
+            {
+                /* Addresses are signed, as in the program */
+                report(cmp, "MEM", (int)((page << DATA_PAGE_SHIFT) | k),
+                       wa[k], wb[k]);
+            }
+        }
+    }
+}
+
+int
+main(int argc, char const *argv[])
+{
+    APEX_Dump a;
+    APEX_Dump b;
+    APEX_Cmp cmp;
+
+    if (argc != 3 && argc != 4)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <dump_file> <dump_file> "
+                "[max_diffs]\n",
+                argv[0]);
+        exit(2);
+    }
+
+    if (!map_dump(&a, argv[1]))
+    {
+        exit(2);
+    }
+    if (!map_dump(&b, argv[2]))
+    {
+        munmap((void *)a.header, a.size);
+        exit(2);
+    }
+
+    memset(&cmp, 0, sizeof(cmp));
+    cmp.max_diffs = argc == 4 ? atol(argv[3]) : CMP_MAX_DIFFS;
+
+    compare_registers(&cmp, a.header, b.header);
+    compare_memory(&cmp, &a, &b);
+
+    /* How long each run took, and which registers the pipeline still had
+     * a write pending for, are not part of the state, only told */
+    if (a.header->regs_pending != b.header->regs_pending)
+    {
+        printf("APEX_CMP: Registers differ in status, invalid = 0x%x/0x%x\n",
+               a.header->regs_pending, b.header->regs_pending);
+    }
+    if (a.header->clock != b.header->clock
+        || a.header->insn_completed != b.header->insn_completed)
+    {
+        printf("APEX_CMP: Runs differ in length, cycles = %d/%d "
+               "instructions = %d/%d\n",
+               a.header->clock, b.header->clock, a.header->insn_completed,
+               b.header->insn_completed);
+    }
+
+    if (cmp.diffs > cmp.max_diffs)
+    {
+        printf("APEX_CMP: %ld more differences not shown\n",
+               cmp.diffs - cmp.max_diffs);
+    }
+    printf("APEX_CMP: %s, differences = %ld\n",
+           cmp.diffs ? "Dumps Differ" : "Dumps Match", cmp.diffs);
+
+    munmap((void *)a.header, a.size);
+    munmap((void *)b.header, b.size);
+    return cmp.diffs ? 1 : 0;
+}
@@ -0,0 +1,1736 @@
+/*
+ * apex_cpu.c
+ * Contains APEX cpu pipeline implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <math.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+
+
+/* Converts the PC(4000 series) into array index for code memory
+ *
+ * Note: PCs below 4000 never index code memory, so a shift is enough here
+ * and keeps the signed divide off the fetch path
+ */
+static inline int
+get_code_memory_index_from_pc(const int pc)
+{
+    return (pc - 4000) >> 2;
+}
+
+/*
+ * Notes the cycle the slot at index insn is first fetched at, for the
+ * incremental mode to tell which snapshots an edit leaves valid
+ */
+static inline void
+note_fetch(APEX_CPU *cpu, int insn)
+{
+    if (cpu->first_fetch
+        && (unsigned int)insn < (unsigned int)cpu->code_memory_slots
+        && cpu->first_fetch[insn] < 0)
+    {
+        cpu->first_fetch[insn] = cpu->clock;
+    }
+}
+
+static void
+print_instruction(const APEX_Instruction *insn)
+{
+    switch (insn->opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_LDR:
+    case OPCODE_STR:
+    {
+        printf("%s,R%d,R%d,R%d ", get_opcode_mnemonic(insn->opcode), insn->rd, insn->rs1,
+               insn->rs2);
+        break;
+    }
+    case OPCODE_CMP:
+    {
+        printf("%s,R%d,R%d ", get_opcode_mnemonic(insn->opcode), insn->rs1, insn->rs2);
+        break;
+    }
+    case OPCODE_MOVC:
+    {
+        printf("%s,R%d,#%d ", get_opcode_mnemonic(insn->opcode), insn->rd, insn->imm);
+        break;
+    }
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_LOAD:
+    {
+        printf("%s,R%d,R%d,#%d ", get_opcode_mnemonic(insn->opcode), insn->rd, insn->rs1,
+               insn->imm);
+        break;
+    }
+
+    case OPCODE_STORE:
+    {
+        printf("%s,R%d,R%d,#%d ", get_opcode_mnemonic(insn->opcode), insn->rs1, insn->rs2,
+               insn->imm);
+        break;
+    }
+
+    case OPCODE_BZ:
+    case OPCODE_BNZ:
+    {
+        printf("%s,#%d ", get_opcode_mnemonic(insn->opcode), insn->imm);
+        break;
+    }
+
+    case OPCODE_HALT:
+    {
+        printf("%s", get_opcode_mnemonic(insn->opcode));
+        break;
+    }
+    }
+}
+
+/* Debug function which prints the CPU stage content
+ *
+ * Note: You can edit this function to print in more detail
+ */
+static void
+print_stage_content(const char *name, const APEX_CPU *cpu,
+                    const CPU_Stage *stage)
+{
+    printf("%-15s: pc(%d) ", name, stage->pc);
+    print_instruction(&cpu->code_memory[stage->insn]);
+    printf("\n");
+}
+
+/* Debug function which prints the register file
+ *
+ * Note: You are not supposed to edit this function
+ */
+static void
+print_reg_file(const APEX_CPU *cpu)
+{
+    int i;
+
+    printf("----------\n%s\n----------\n", "Registers:");
+
+    for (int i = 0; i < REG_FILE_SIZE / 2; ++i)
+    {
+        printf("R%-3d[%-3d] ", i, cpu->regs[i]);
+    }
+
+    printf("\n");
+
+    for (i = (REG_FILE_SIZE / 2); i < REG_FILE_SIZE; ++i)
+    {
+        printf("R%-3d[%-3d] ", i, cpu->regs[i]);
+    }
+
+    printf("\n");
+}
+
+
+
+static void
+architectural_register_display(const APEX_CPU *cpu){
+    printf("\n\t=============== STATE OF ARCHITECTURAL REGISTER FILE ==========\t\n");
+    for(int i=0; i<REG_FILE_SIZE; i++){
+        if(!(cpu->regs_pending & (1u << i))){
+            printf("|\t REG[%-2d] \t|\t Value=%-3d \t|\t Status = VALID \t|\n",i,cpu->regs[i]);
+        }else{
+            printf("|\t REG[%-2d] \t|\t Value=%-3d \t|\t Status = INVALID \t|\n",i,cpu->regs[i]);
+        }
+    }
+}
+
+static void
+display_data_memory(const APEX_CPU *cpu){
+    printf("\n\t============== STATE OF DATA MEMORY =============\t\n");
+    for(int i=0; i<DATA_MEMORY_SIZE; i++){
+        printf("|\t MEM[%-2d] \t|\t Data Value=%-3d \t|\n",i,APEX_memory_peek(&cpu->data_memory, i));
+    }  
+}
+
+/*
+ * Prints only the data memory words the program stored a new value to,
+ * anywhere in memory, by comparing the dirty pages with their originals
+ */
+static void
+display_changed_data_memory(const APEX_CPU *cpu){
+    const int *words;
+    const int *clean;
+    unsigned int page;
+
+    printf("\n\t========== CHANGED WORDS OF DATA MEMORY =========\t\n");
+    for(page = APEX_memory_next_dirty_page(&cpu->data_memory, 0);
+        page != DATA_NO_PAGE;
+        page = APEX_memory_next_dirty_page(&cpu->data_memory, page + 1)){
+        words = APEX_memory_page(&cpu->data_memory, page);
+        clean = APEX_memory_clean_page(&cpu->data_memory, page);
+        for(int i=0; i<DATA_PAGE_WORDS; i++){
+            if(words[i] != clean[i]){
+                printf("|\t MEM[%-2d] \t|\t Data Value=%-3d \t|\n",
+                       (int)((page << DATA_PAGE_SHIFT) | i), words[i]);
+            }
+        }
+    }
+}
+
+/*
+ * Shows or dumps the final state of the run as the options ask
+ */
+static void
+finish_run(const APEX_CPU *cpu)
+{
+    if(cpu->display){
+        APEX_cpu_display_state(cpu);
+    }
+    if (cpu->dump_file)
+    {
+        APEX_dump_save(cpu, cpu->dump_file);
+    }
+}
+
+
+/*
+ * Per-opcode stage handlers
+ *
+ * Each opcode gets one handler per pipeline stage. The stage functions below
+ * call through insn_handlers with the opcode byte of the instruction in code
+ * memory instead of switching on the opcode every cycle.
+ */
+static void
+set_zero_flag(APEX_CPU *cpu, int result)
+{
+    if (result == 0)
+    {
+        cpu->zero_flag = TRUE;
+    }
+    else
+    {
+        cpu->zero_flag = FALSE;
+    }
+}
+
+/* Makes a result visible to decode before it reaches writeback, only the
+ * forwarding pipeline has the path */
+static inline void
+forward_result(APEX_CPU *cpu, int rd, int value)
+{
+#if APEX_FORWARDING
+    cpu->data_forward_buffer[rd] = value;
+    cpu->data_forward_valid |= 1u << rd;
+#endif
+}
+
+/* Registers decode cannot read yet */
+static inline unsigned int
+unavailable_regs(const APEX_CPU *cpu)
+{
+#if APEX_FORWARDING
+    return ~cpu->data_forward_valid;
+#else
+    return cpu->regs_pending;
+#endif
+}
+
+/* Decode: instruction has no register operands */
+static void
+decode_nop(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+}
+
+/* Decode: reads rs1 and rs2 from the register file, or the forwarding
+ * buffer, unused fields are R0 */
+static void
+decode_operands(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+#if APEX_FORWARDING
+    stage->rs1_value = cpu->data_forward_buffer[insn->rs1];
+    stage->rs2_value = cpu->data_forward_buffer[insn->rs2];
+#else
+    stage->rs1_value = cpu->regs[insn->rs1];
+    stage->rs2_value = cpu->regs[insn->rs2];
+#endif
+}
+
+/* Decode: STORE, the forwarding pipeline latches the forward valid bit of
+ * rs1 as its base */
+static void
+decode_store_operands(APEX_CPU *cpu, CPU_Stage *stage,
+                      const APEX_Instruction *insn)
+{
+#if APEX_FORWARDING
+    stage->rs1_value = (cpu->data_forward_valid >> insn->rs1) & 1;
+#else
+    decode_operands(cpu, stage, insn);
+#endif
+}
+
+static void
+execute_nop(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+}
+
+static void
+execute_add(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    stage->result_buffer = stage->rs1_value + stage->rs2_value;
+    forward_result(cpu, insn->rd, stage->result_buffer);
+    set_zero_flag(cpu, stage->result_buffer);
+}
+
+static void
+execute_sub(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    stage->result_buffer = stage->rs1_value - stage->rs2_value;
+    forward_result(cpu, insn->rd, stage->result_buffer);
+    set_zero_flag(cpu, stage->result_buffer);
+}
+
+static void
+execute_mul(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    stage->result_buffer = stage->rs1_value * stage->rs2_value;
+    forward_result(cpu, insn->rd, stage->result_buffer);
+    set_zero_flag(cpu, stage->result_buffer);
+}
+
+static void
+execute_div(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    stage->result_buffer = stage->rs1_value / stage->rs2_value;
+    forward_result(cpu, insn->rd, stage->result_buffer);
+    set_zero_flag(cpu, stage->result_buffer);
+}
+
+static void
+execute_addl(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    stage->result_buffer = stage->rs1_value + insn->imm;
+    forward_result(cpu, insn->rd, stage->result_buffer);
+}
+
+static void
+execute_subl(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    stage->result_buffer = stage->rs1_value - insn->imm;
+    forward_result(cpu, insn->rd, stage->result_buffer);
+}
+
+static void
+execute_and(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    stage->result_buffer = stage->rs1_value & stage->rs2_value;
+    forward_result(cpu, insn->rd, stage->result_buffer);
+    set_zero_flag(cpu, stage->result_buffer);
+}
+
+static void
+execute_or(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    stage->result_buffer = stage->rs1_value | stage->rs2_value;
+    forward_result(cpu, insn->rd, stage->result_buffer);
+    set_zero_flag(cpu, stage->result_buffer);
+}
+
+static void
+execute_xor(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    stage->result_buffer = stage->rs1_value ^ stage->rs2_value;
+    forward_result(cpu, insn->rd, stage->result_buffer);
+    set_zero_flag(cpu, stage->result_buffer);
+}
+
+/* Execute: STR */
+static void
+execute_address_rs2(APEX_CPU *cpu, CPU_Stage *stage,
+                    const APEX_Instruction *insn)
+{
+    stage->memory_address = stage->rs1_value + stage->rs2_value;
+}
+
+/* Execute: STORE */
+static void
+execute_address_imm(APEX_CPU *cpu, CPU_Stage *stage,
+                    const APEX_Instruction *insn)
+{
+    stage->memory_address = stage->rs1_value + insn->imm;
+}
+
+/* Execute: LDR, the forwarding pipeline forwards the loaded word from here */
+static void
+execute_ldr(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    execute_address_rs2(cpu, stage, insn);
+#if APEX_FORWARDING
+    forward_result(cpu, insn->rd,
+                   APEX_memory_load(&cpu->data_memory, stage->memory_address));
+#endif
+}
+
+/* Execute: LOAD */
+static void
+execute_load(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    execute_address_imm(cpu, stage, insn);
+#if APEX_FORWARDING
+    forward_result(cpu, insn->rd,
+                   APEX_memory_load(&cpu->data_memory, stage->memory_address));
+#endif
+}
+
+static void
+execute_movc(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    stage->result_buffer = insn->imm;
+    forward_result(cpu, insn->rd, stage->result_buffer);
+    set_zero_flag(cpu, stage->result_buffer);
+}
+
+static void
+take_branch(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    /* Calculate new PC, and send it to fetch unit */
+    cpu->pc = stage->pc + insn->imm;
+
+    /* Flush decode and hold fetch for this cycle, the target instruction is
+     * fetched from next cycle */
+    cpu->fetch_from_next_cycle = TRUE;
+
+    /* Make sure fetch stage is enabled to start fetching from new PC */
+    cpu->fetch.has_insn = TRUE;
+}
+
+static void
+execute_bz(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    if (cpu->zero_flag == TRUE)
+    {
+        take_branch(cpu, stage, insn);
+    }
+}
+
+static void
+execute_bnz(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    if (cpu->zero_flag == FALSE)
+    {
+        take_branch(cpu, stage, insn);
+    }
+}
+
+/* CMP continues into the BZ redirect, same as the case fall-through it
+ * replaces */
+static void
+execute_cmp(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    if (stage->rs1_value == stage->rs2_value)
+    {
+        cpu->zero_flag = TRUE;
+    }
+    else
+    {
+        cpu->zero_flag = FALSE;
+    }
+    execute_bz(cpu, stage, insn);
+}
+
+static void
+memory_nop(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+}
+
+/* Memory: STORE, STR */
+static void
+memory_store(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    APEX_memory_store(&cpu->data_memory, stage->memory_address,
+                      cpu->regs[insn->rd]);
+}
+
+/* Memory: LOAD, LDR */
+static void
+memory_load(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    stage->result_buffer = APEX_memory_load(&cpu->data_memory,
+                                            stage->memory_address);
+    forward_result(cpu, insn->rd, stage->result_buffer);
+}
+
+static void
+writeback_nop(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+}
+
+/* Writeback: every instruction that produces rd */
+static void
+writeback_rd(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    cpu->regs[insn->rd] = stage->result_buffer;
+    cpu->regs_pending &= ~(1u << insn->rd);
+}
+
+/* Execute: decoupled mode, the values come from the functional thread and
+ * only the timing of the instruction is modeled here */
+static void
+execute_stream(APEX_CPU *cpu, CPU_Stage *stage, const APEX_Instruction *insn)
+{
+    APEX_Trace_Record record;
+
+    if (!APEX_stream_next(cpu->stream, &record))
+    {
+        /* Past HALT, the stall pipeline lets one more instruction into
+         * execute before HALT retires */
+        return;
+    }
+
+    if (record.pc != stage->pc)
+    {
+        cpu->stream_lost = TRUE;
+        return;
+    }
+
+    stage->result_buffer = record.value;
+    stage->memory_address = record.memory_address;
+    if (cpu->code_deps[stage->insn].dest_mask)
+    {
+        forward_result(cpu, insn->rd, record.value);
+    }
+    cpu->zero_flag = record.zero_flag;
+
+    if (record.taken)
+    {
+        take_branch(cpu, stage, insn);
+    }
+}
+
+/* Memory: STORE, STR in decoupled mode, execute got the word to store */
+static void
+memory_stream_store(APEX_CPU *cpu, CPU_Stage *stage,
+                    const APEX_Instruction *insn)
+{
+    APEX_memory_store(&cpu->data_memory, stage->memory_address,
+                      stage->result_buffer);
+}
+
+/* Stage handlers of every opcode, indexed by numeric opcode */
+static const APEX_Opcode_Handlers insn_handlers[] = {
+    [OPCODE_ADD] = {decode_operands, execute_add, memory_nop, writeback_rd},
+    [OPCODE_SUB] = {decode_operands, execute_sub, memory_nop, writeback_rd},
+    [OPCODE_MUL] = {decode_operands, execute_mul, memory_nop, writeback_rd},
+    [OPCODE_DIV] = {decode_operands, execute_div, memory_nop, writeback_rd},
+    [OPCODE_AND] = {decode_operands, execute_and, memory_nop, writeback_rd},
+    [OPCODE_OR] = {decode_operands, execute_or, memory_nop, writeback_rd},
+    [OPCODE_XOR] = {decode_operands, execute_xor, memory_nop, writeback_rd},
+    [OPCODE_MOVC] = {decode_nop, execute_movc, memory_nop, writeback_rd},
+    [OPCODE_LOAD] = {decode_operands, execute_load, memory_load, writeback_rd},
+    [OPCODE_STORE] = {decode_store_operands, execute_address_imm, memory_store, writeback_nop},
+    [OPCODE_BZ] = {decode_nop, execute_bz, memory_nop, writeback_nop},
+    [OPCODE_BNZ] = {decode_nop, execute_bnz, memory_nop, writeback_nop},
+    [OPCODE_HALT] = {decode_nop, execute_nop, memory_nop, writeback_nop},
+    [OPCODE_STR] = {decode_operands, execute_address_rs2, memory_store, writeback_nop},
+    [OPCODE_LDR] = {decode_operands, execute_ldr, memory_load, writeback_rd},
+    [OPCODE_ADDL] = {decode_operands, execute_addl, memory_nop, writeback_rd},
+    [OPCODE_SUBL] = {decode_operands, execute_subl, memory_nop, writeback_rd},
+    [OPCODE_CMP] = {decode_operands, execute_cmp, memory_nop, writeback_nop},
+};
+
+/* Stage handlers of the decoupled mode. Decode still reads its operands,
+ * which has no effect on timing */
+static const APEX_Opcode_Handlers stream_handlers[] = {
+    [OPCODE_ADD] = {decode_operands, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_SUB] = {decode_operands, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_MUL] = {decode_operands, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_DIV] = {decode_operands, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_AND] = {decode_operands, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_OR] = {decode_operands, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_XOR] = {decode_operands, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_MOVC] = {decode_nop, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_LOAD] = {decode_operands, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_STORE] = {decode_store_operands, execute_stream, memory_stream_store, writeback_nop},
+    [OPCODE_BZ] = {decode_nop, execute_stream, memory_nop, writeback_nop},
+    [OPCODE_BNZ] = {decode_nop, execute_stream, memory_nop, writeback_nop},
+    [OPCODE_HALT] = {decode_nop, execute_nop, memory_nop, writeback_nop},
+    [OPCODE_STR] = {decode_operands, execute_stream, memory_stream_store, writeback_nop},
+    [OPCODE_LDR] = {decode_operands, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_ADDL] = {decode_operands, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_SUBL] = {decode_operands, execute_stream, memory_nop, writeback_rd},
+    [OPCODE_CMP] = {decode_operands, execute_stream, memory_nop, writeback_nop},
+};
+
+/*
+ * Fetch Stage of APEX Pipeline
+ *
+ * The fetch latch is the fetch unit's own state rather than a pipeline
+ * register, so it is not double buffered. Decode's stall and execute's
+ * branch redirect reach it in the same cycle.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_fetch(APEX_CPU *cpu)
+{
+    CPU_Latches *next = cpu->next_latches;
+
+#if APEX_FORWARDING
+    /* Fetch does not wait for a stalled decode */
+    if (cpu->fetch.has_insn)
+#else
+    if (cpu->fetch.has_insn && !cpu->fetch.stage_stalling)//normal execution
+#endif
+    {
+        /* This fetches new branch target instruction from next cycle */
+        if (cpu->fetch_from_next_cycle == TRUE)
+        {
+            cpu->fetch_from_next_cycle = FALSE;
+            cpu->fetch_stall_cycles++;
+            /* Skip this cycle*/
+            return;
+        }
+
+        /* Store current PC and its code memory index in fetch latch */
+        cpu->fetch.pc = cpu->pc;
+        cpu->fetch.insn = get_code_memory_index_from_pc(cpu->pc);
+        note_fetch(cpu, cpu->fetch.insn);
+
+        /* Update PC for next instruction */
+        cpu->pc += 4;
+
+        /* Copy data from fetch latch to decode latch*/
+        next->decode = cpu->fetch;
+
+        if (ENABLE_DEBUG_MESSAGES(cpu))
+        {
+            print_stage_content("Fetch", cpu, &cpu->fetch);
+        }
+
+        /* Stop fetching new instructions if HALT is fetched */
+        if (cpu->code_memory[cpu->fetch.insn].opcode == OPCODE_HALT)
+        {
+            cpu->fetch.has_insn = FALSE;
+        }
+    }
+#if !APEX_FORWARDING
+    else if(cpu->fetch.has_insn == TRUE && cpu->fetch.stage_stalling == TRUE){
+         /* This fetches new branch target instruction from next cycle */
+        if (cpu->fetch_from_next_cycle == TRUE)
+        {
+            cpu->fetch_from_next_cycle = FALSE;
+            cpu->fetch_stall_cycles++;
+            /* Skip this cycle*/
+            return;
+        }
+
+        /* Store current PC and its code memory index in fetch latch, it is
+         * handed to decode once the stall clears */
+        cpu->fetch.pc = cpu->pc;
+        cpu->fetch.insn = get_code_memory_index_from_pc(cpu->pc);
+        note_fetch(cpu, cpu->fetch.insn);
+        cpu->fetch.has_insn = FALSE;
+        cpu->fetch_stall_cycles++;
+
+        if (ENABLE_DEBUG_MESSAGES(cpu))
+        {
+            print_stage_content("Fetch", cpu, &cpu->fetch);
+        }
+    }
+    else if(cpu->fetch.has_insn == FALSE && cpu->fetch.stage_stalling == FALSE){
+        cpu->fetch.has_insn = TRUE;
+        next->decode = cpu->fetch;
+        cpu->pc +=4;
+    }
+#endif
+    else
+    {
+        cpu->fetch_stall_cycles++;
+    }
+
+}
+
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_decode(APEX_CPU *cpu)
+{
+    const CPU_Stage *decode = &cpu->cur_latches->decode;
+    CPU_Latches *next = cpu->next_latches;
+    const APEX_Instruction *insn;
+    const APEX_Insn_Deps *deps;
+
+    /* A taken branch in execute flushes the instruction in decode */
+    if (decode->has_insn && !cpu->fetch_from_next_cycle)
+    {
+        next->decode = *decode;
+        insn = &cpu->code_memory[decode->insn];
+        deps = &cpu->code_deps[decode->insn];
+
+        if (deps->src_mask & unavailable_regs(cpu))
+        {
+            /* A source register is still waiting for its value */
+            next->decode.stage_stalling = TRUE;
+            cpu->fetch.stage_stalling = TRUE;
+        }
+        else
+        {
+            /* Instructions without source registers leave the stall state
+             * alone */
+            if (deps->src_mask)
+            {
+                /* Read operands */
+                cpu->handlers[insn->opcode].decode(cpu, &next->decode, insn);
+                next->decode.stage_stalling = FALSE;
+                cpu->fetch.stage_stalling = FALSE;
+            }
+            cpu->regs_pending |= deps->dest_mask;
+        }
+
+        /* Copy data from decode latch to execute latch*/
+        if (next->decode.stage_stalling == FALSE)
+        {
+            next->execute = next->decode;
+            next->decode.has_insn = FALSE;
+        }
+        else
+        {
+            next->execute.has_insn = FALSE;
+            cpu->decode_stall_cycles++;
+        }
+
+        if (ENABLE_DEBUG_MESSAGES(cpu))
+        {
+            print_stage_content("Decode/RF", cpu, &next->decode);
+        }
+    }
+    else
+    {
+        next->decode.has_insn = FALSE;
+        next->execute.has_insn = FALSE;
+    }
+}
+
+/*
+ * Execute Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_execute(APEX_CPU *cpu)
+{
+    const CPU_Stage *execute = &cpu->cur_latches->execute;
+    CPU_Stage *memory = &cpu->next_latches->memory;
+    const APEX_Instruction *insn;
+
+    if (execute->has_insn)
+    {
+        /* Copy data from execute latch to memory latch, and execute logic
+         * based on instruction type there */
+        *memory = *execute;
+        insn = &cpu->code_memory[execute->insn];
+        cpu->handlers[insn->opcode].execute(cpu, memory, insn);
+
+        if (ENABLE_DEBUG_MESSAGES(cpu))
+        {
+            print_stage_content("Execute", cpu, memory);
+        }
+    }
+    else
+    {
+        memory->has_insn = FALSE;
+    }
+}
+
+/*
+ * Memory Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_memory(APEX_CPU *cpu)
+{
+    const CPU_Stage *memory = &cpu->cur_latches->memory;
+    CPU_Stage *writeback = &cpu->next_latches->writeback;
+    const APEX_Instruction *insn;
+
+    if (memory->has_insn)
+    {
+        /* Copy data from memory latch to writeback latch*/
+        *writeback = *memory;
+        insn = &cpu->code_memory[memory->insn];
+        cpu->handlers[insn->opcode].memory(cpu, writeback, insn);
+
+        if (ENABLE_DEBUG_MESSAGES(cpu))
+        {
+            print_stage_content("Memory", cpu, writeback);
+        }
+    }
+    else
+    {
+        writeback->has_insn = FALSE;
+    }
+}
+
+/*
+ * Writeback Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+APEX_writeback(APEX_CPU *cpu)
+{
+    CPU_Stage *writeback = &cpu->cur_latches->writeback;
+    const APEX_Instruction *insn;
+
+    if (writeback->has_insn)
+    {
+        insn = &cpu->code_memory[writeback->insn];
+
+        /* Write result to register file based on instruction type */
+        cpu->handlers[insn->opcode].writeback(cpu, writeback, insn);
+
+        cpu->insn_completed++;
+
+        if (ENABLE_DEBUG_MESSAGES(cpu))
+        {
+            print_stage_content("Writeback", cpu, writeback);
+        }
+
+        if (insn->opcode == OPCODE_HALT)
+        {
+            /* Stop the APEX simulator */
+            return TRUE;
+        }
+    }
+
+    /* Default */
+    return 0;
+}
+
+/*
+ * Returns TRUE when the instruction in decode cannot issue: it waits on a
+ * source register, or has none and keeps its stall
+ */
+static int
+decode_blocked(const APEX_CPU *cpu)
+{
+    const CPU_Stage *decode = &cpu->cur_latches->decode;
+    const APEX_Insn_Deps *deps = &cpu->code_deps[decode->insn];
+
+    return (deps->src_mask & unavailable_regs(cpu))
+           || (!deps->src_mask && decode->stage_stalling);
+}
+
+/*
+ * Returns TRUE when no latch can change in the coming cycle, and so in any
+ * later one: nothing is in flight past decode to write a register or
+ * redirect fetch, decode is empty or held for good, and fetch is held.
+ * Stepping the clock from here only adds stall cycles
+ */
+static int
+pipeline_quiescent(const APEX_CPU *cpu)
+{
+    if (cpu->cur_latches->execute.has_insn || cpu->cur_latches->memory.has_insn
+        || cpu->cur_latches->writeback.has_insn || cpu->fetch_from_next_cycle)
+    {
+        return FALSE;
+    }
+
+    if (cpu->cur_latches->decode.has_insn && !decode_blocked(cpu))
+    {
+        return FALSE;
+    }
+
+#if APEX_FORWARDING
+    return !cpu->fetch.has_insn;
+#else
+    return !cpu->fetch.has_insn && cpu->fetch.stage_stalling;
+#endif
+}
+
+/*
+ * Makes the latches written this cycle the input of the next one
+ */
+static void
+swap_latch_banks(APEX_CPU *cpu)
+{
+    CPU_Latches *latches = cpu->cur_latches;
+
+    cpu->cur_latches = cpu->next_latches;
+    cpu->next_latches = latches;
+}
+
+/*
+ * Starts the pipeline empty at cpu->pc, once the functional simulator has
+ * brought the architectural state up to it
+ */
+static void
+start_pipeline_at_pc(APEX_CPU *cpu)
+{
+#if APEX_FORWARDING
+    int i;
+
+#endif
+    memset(cpu->latch_bank, 0, sizeof(cpu->latch_bank));
+    memset(&cpu->fetch, 0, sizeof(cpu->fetch));
+    cpu->fetch.has_insn = TRUE;
+    cpu->fetch_from_next_cycle = FALSE;
+    cpu->regs_pending = 0;
+#if APEX_FORWARDING
+
+    /* Registers written functionally have their value forwarded */
+    for (i = 0; i < REG_FILE_SIZE; i++)
+    {
+        if (cpu->regs_written & (1u << i))
+        {
+            cpu->data_forward_buffer[i] = cpu->regs[i];
+        }
+    }
+    cpu->data_forward_valid |= cpu->regs_written;
+#endif
+}
+
+/*
+ * Records the architectural state of cpu, which must be between two
+ * instructions, as after the functional simulator. The checkpoint gets a
+ * copy of data memory, which APEX_checkpoint_free gives back
+ */
+void
+APEX_checkpoint_save(const APEX_CPU *cpu, APEX_Checkpoint *checkpoint)
+{
+    checkpoint->pc = cpu->pc;
+    checkpoint->insn_completed = cpu->insn_completed;
+    checkpoint->zero_flag = cpu->zero_flag;
+    checkpoint->regs_written = cpu->regs_written;
+    memcpy(checkpoint->regs, cpu->regs, sizeof(checkpoint->regs));
+    APEX_memory_init(&checkpoint->data_memory, FALSE);
+    APEX_memory_copy(&checkpoint->data_memory, &cpu->data_memory);
+}
+
+/*
+ * Unmaps the data memory of a checkpoint
+ */
+void
+APEX_checkpoint_free(APEX_Checkpoint *checkpoint)
+{
+    APEX_memory_free(&checkpoint->data_memory);
+}
+
+/*
+ * Starts the pipeline empty from the architectural state cpu holds, with
+ * the clock and the stall counts at zero. Data memory is left as it is, so
+ * a forked copy of a CPU goes on sharing it. cpu may be a plain copy of
+ * another APEX_CPU, its latch pointers are set up again here
+ */
+void
+APEX_cpu_restart(APEX_CPU *cpu)
+{
+    cpu->clock = 0;
+    cpu->decode_stall_cycles = 0;
+    cpu->fetch_stall_cycles = 0;
+    cpu->run_status = RUN_RETIRED;
+    cpu->cur_latches = &cpu->latch_bank[0];
+    cpu->next_latches = &cpu->latch_bank[1];
+#if APEX_FORWARDING
+    cpu->data_forward_valid = 0;
+#endif
+    start_pipeline_at_pc(cpu);
+}
+
+/*
+ * Loads a checkpoint into cpu and starts the pipeline empty from it, see
+ * APEX_cpu_restart. Data memory is copied into that of cpu, replacing it,
+ * so a plain copy of another APEX_CPU must have had APEX_memory_init run
+ * on its data_memory first, or the pages of the original would be freed
+ */
+void
+APEX_cpu_start_at(APEX_CPU *cpu, const APEX_Checkpoint *checkpoint)
+{
+    cpu->pc = checkpoint->pc;
+    cpu->insn_completed = checkpoint->insn_completed;
+    cpu->zero_flag = checkpoint->zero_flag;
+    cpu->regs_written = checkpoint->regs_written;
+    memcpy(cpu->regs, checkpoint->regs, sizeof(cpu->regs));
+    APEX_memory_copy(&cpu->data_memory, &checkpoint->data_memory);
+    APEX_cpu_restart(cpu);
+}
+
+/*
+ * Runs the pipeline until insns more instructions have retired or the clock
+ * reaches max_cycles, a negative limit being none.
+ *
+ * Returns RUN_RETIRED once a limit is reached, or RUN_HALTED or
+ * RUN_DEADLOCKED if the program ended first
+ */
+static int
+run_pipeline(APEX_CPU *cpu, int insns, int max_cycles)
+{
+    int target = cpu->insn_completed + insns;
+
+    while ((insns < 0 || cpu->insn_completed < target)
+           && (max_cycles < 0 || cpu->clock < max_cycles))
+    {
+        if (APEX_writeback(cpu))
+        {
+            return RUN_HALTED;
+        }
+
+        APEX_memory(cpu);
+        APEX_execute(cpu);
+        APEX_decode(cpu);
+        APEX_fetch(cpu);
+        swap_latch_banks(cpu);
+        cpu->clock++;
+
+        if (cpu->cycle_skipping && pipeline_quiescent(cpu))
+        {
+            return RUN_DEADLOCKED;
+        }
+    }
+
+    return RUN_RETIRED;
+}
+
+/*
+ * Runs the pipeline until insns more instructions have retired, a negative
+ * insns being no limit, see run_pipeline
+ */
+int
+APEX_cpu_run_insns(APEX_CPU *cpu, int insns)
+{
+    return run_pipeline(cpu, insns, -1);
+}
+
+/*
+ * Runs the pipeline until the clock reaches max_cycles, see run_pipeline
+ */
+int
+APEX_cpu_run_cycles(APEX_CPU *cpu, int max_cycles)
+{
+    return run_pipeline(cpu, -1, max_cycles);
+}
+
+/*
+ * Stops fetching and lets the instructions past fetch finish, so that the
+ * architectural state is that of cpu->pc and the functional simulator can
+ * take over from there. The instruction in the fetch latch has not been
+ * run and is fetched again.
+ *
+ * Returns TRUE if HALT retired meanwhile
+ */
+static int
+drain_pipeline(APEX_CPU *cpu)
+{
+    const CPU_Latches *cur;
+
+    for (;;)
+    {
+        cur = cpu->cur_latches;
+        if (!cur->execute.has_insn && !cur->memory.has_insn
+            && !cur->writeback.has_insn
+            && (!cur->decode.has_insn || cpu->fetch_from_next_cycle
+                || decode_blocked(cpu)))
+        {
+            break;
+        }
+
+        if (APEX_writeback(cpu))
+        {
+            return TRUE;
+        }
+
+        APEX_memory(cpu);
+        APEX_execute(cpu);
+        APEX_decode(cpu);
+        swap_latch_banks(cpu);
+        cpu->clock++;
+    }
+
+    /* An instruction held in decode has not been run either */
+    if (cur->decode.has_insn && !cpu->fetch_from_next_cycle)
+    {
+        cpu->pc = cur->decode.pc;
+    }
+    cpu->fetch_from_next_cycle = FALSE;
+    return FALSE;
+}
+
+/*
+ * Sampling mode: runs the program functionally, and every sample_period
+ * instructions runs sample_warmup instructions through the pipeline to
+ * fill it, then measures the CPI of the next sample_window. The pipeline
+ * keeps no state besides the architectural one between samples, so the
+ * functional simulator has nothing else to keep warm.
+ *
+ * Prints the mean CPI of the samples with its 95% confidence interval
+ */
+static void
+run_sampled(APEX_CPU *cpu)
+{
+    int gap = cpu->sample_period - cpu->sample_warmup - cpu->sample_window;
+    int status = RUN_RETIRED;
+    int samples = 0;
+    int start_clock;
+    int start_insns;
+    double cpi;
+    double sum = 0.0;
+    double sum_squares = 0.0;
+    double mean = 0.0;
+    double half_width = 0.0;
+
+    if (cpu->fast_forward_insns > 0 || cpu->fast_forward_pc > 0)
+    {
+        status = APEX_functional_run(
+            cpu, cpu->fast_forward_insns > 0 ? cpu->fast_forward_insns : -1,
+            cpu->fast_forward_pc > 0 ? cpu->fast_forward_pc : -1);
+    }
+
+    while (status == RUN_RETIRED)
+    {
+        status = APEX_functional_run(cpu, gap, -1);
+        if (status != RUN_RETIRED)
+        {
+            break;
+        }
+
+        start_pipeline_at_pc(cpu);
+        status = APEX_cpu_run_insns(cpu, cpu->sample_warmup);
+        if (status != RUN_RETIRED)
+        {
+            break;
+        }
+
+        start_clock = cpu->clock;
+        start_insns = cpu->insn_completed;
+        status = APEX_cpu_run_insns(cpu, cpu->sample_window);
+        if (status == RUN_DEADLOCKED)
+        {
+            break;
+        }
+
+        /* A window cut short by HALT still counts */
+        if (cpu->insn_completed > start_insns)
+        {
+            cpi = (double)(cpu->clock - start_clock)
+                  / (cpu->insn_completed - start_insns);
+            sum += cpi;
+            sum_squares += cpi * cpi;
+            samples++;
+        }
+
+        if (status == RUN_HALTED || drain_pipeline(cpu))
+        {
+            break;
+        }
+    }
+
+    if (status == RUN_LEFT_CODE)
+    {
+        fprintf(stderr, "APEX_Error: The program left code memory at PC %d\n", cpu->pc);
+        printf("APEX_CPU: Simulation Stopped, instructions = %d samples = %d\n", cpu->insn_completed, samples);
+        return;
+    }
+
+    cpu->run_status = (status == RUN_DEADLOCKED) ? RUN_DEADLOCKED : RUN_HALTED;
+    if (status == RUN_DEADLOCKED)
+    {
+        printf("APEX_CPU: Simulation Deadlocked, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+    }
+    else
+    {
+        printf("APEX_CPU: Simulation Complete, instructions = %d samples = %d\n", cpu->insn_completed, samples);
+    }
+
+    if (samples == 0)
+    {
+        printf("APEX_SAMPLE: No sample was taken, the program is shorter than the sampling period\n");
+        return;
+    }
+
+    mean = sum / samples;
+    if (samples > 1)
+    {
+        /* Normal approximation, the sample standard deviation over the
+         * square root of the number of samples */
+        half_width = 1.96 * sqrt(fmax(0.0, (sum_squares - samples * mean * mean)
+                                               / (samples - 1))
+                                 / samples);
+    }
+    printf("APEX_SAMPLE: CPI = %.4f +/- %.4f (95%% confidence), estimated cycles = %.0f\n", mean, half_width, mean * cpu->insn_completed);
+}
+
+/*
+ * Frees the code memory and dependency info of cpu that were too big for
+ * its arena, and forgets the program
+ */
+static void
+free_program(APEX_CPU *cpu)
+{
+    if (!APEX_arena_owns(cpu->arena, cpu->code_memory))
+    {
+        free(cpu->code_memory);
+    }
+    if (!APEX_arena_owns(cpu->arena, cpu->code_deps))
+    {
+        free(cpu->code_deps);
+    }
+    cpu->code_memory = NULL;
+    cpu->code_deps = NULL;
+    cpu->code_memory_slots = 0;
+}
+
+/*
+ * Parses filename into code memory, in the arena of cpu after the CPU
+ * itself, giving back the space of any program loaded before. A program
+ * too big for the arena goes on the heap. A binary image also sets
+ * data_memory, which is clean after.
+ *
+ * Returns FALSE if the file could not be loaded, cpu then has no program
+ */
+static int
+load_program(APEX_CPU *cpu, const char *filename, APEX_Memory *data_memory)
+{
+    free_program(cpu);
+    APEX_arena_release(cpu->arena, cpu->arena_mark);
+
+    cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size,
+                                          cpu->arena, data_memory);
+    if (!cpu->code_memory)
+    {
+        return FALSE;
+    }
+
+    /* Changes are told apart from the data memory the program starts with */
+    APEX_memory_mark_clean(data_memory);
+
+    cpu->code_deps = create_insn_deps(cpu->code_memory, cpu->code_memory_size,
+                                      cpu->arena);
+    if (!cpu->code_deps)
+    {
+        free_program(cpu);
+        return FALSE;
+    }
+
+    cpu->code_memory_slots = cpu->code_memory_size + CODE_MEMORY_PADDING;
+    return TRUE;
+}
+
+/*
+ * This function creates and initializes APEX cpu.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+APEX_CPU *
+APEX_cpu_init(const char *filename, const char *keywords,const int cycles)
+{
+    int i;
+    APEX_CPU *cpu;
+    APEX_Arena *arena;
+
+#if !APEX_TRACE
+    if(strcmp(keywords,"display")==0){
+       fprintf(stderr, "APEX_Error: display needs a build with tracing\n");
+       return NULL;
+    }
+#endif
+
+    if (!filename)
+    {
+        return NULL;
+    }
+
+    /* The CPU comes first in its arena, its program follows */
+    arena = APEX_arena_create(ARENA_SIZE, ENABLE_ARENA_HUGE_PAGES);
+    if (!arena)
+    {
+        return NULL;
+    }
+    cpu = APEX_arena_alloc(arena, sizeof(APEX_CPU));
+    cpu->arena = arena;
+    cpu->arena_mark = APEX_arena_mark(arena);
+
+    /* Initialize PC, Registers and all pipeline stages */
+    cpu->pc = 4000;
+    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
+    cpu->regs_pending = 0;
+
+    APEX_memory_init(&cpu->data_memory, ENABLE_DATA_HUGE_PAGES);
+    cpu->single_step = ENABLE_SINGLE_STEP;
+    cpu->cycle_skipping = ENABLE_CYCLE_SKIPPING;
+
+    /* Only display prints every stage, other keywords print the result */
+    cpu->debug_messages = strcmp(keywords, "simulate") != 0
+                          && strcmp(keywords, "sample") != 0
+                          && strcmp(keywords, "interval") != 0
+                          && strcmp(keywords, "sweep") != 0;
+    cpu->display = TRUE;
+
+    /* Parse input file and create code memory */
+    if (!load_program(cpu, filename, &cpu->data_memory))
+    {
+        APEX_memory_free(&cpu->data_memory);
+        APEX_arena_destroy(arena);
+        return NULL;
+    }
+
+    if (ENABLE_DEBUG_MESSAGES(cpu))
+    {
+        fprintf(stderr,
+                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
+                cpu->code_memory_size);
+        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
+        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
+        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
+               "imm");
+
+        for (i = 0; i < cpu->code_memory_size; ++i)
+        {
+            printf("%-9s %-9d %-9d %-9d %-9d\n",
+                   get_opcode_mnemonic(cpu->code_memory[i].opcode),
+                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
+                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+        }
+    }
+
+    cpu->cur_latches = &cpu->latch_bank[0];
+    cpu->next_latches = &cpu->latch_bank[1];
+    cpu->handlers = insn_handlers;
+
+    /* To start fetch stage */
+    cpu->fetch.has_insn = TRUE;
+
+    if (strcmp(keywords, "sample") == 0)
+    {
+        cpu->sample_period = SAMPLE_PERIOD;
+        cpu->sample_warmup = SAMPLE_WARMUP;
+        cpu->sample_window = SAMPLE_WINDOW;
+    }
+    else if (strcmp(keywords, "interval") == 0)
+    {
+        cpu->interval_insns = INTERVAL_INSNS;
+        cpu->interval_warmup = INTERVAL_WARMUP;
+    }
+    cpu->incremental_every = INCREMENTAL_EVERY;
+    cpu->cycle_limit = cycles;
+    
+    return cpu;
+}
+
+/*
+ * Loads filename into cpu in place of its program and starts it over from
+ * PC 4000 with zeroed state, keeping the settings of cpu. Nothing is freed
+ * besides translations of the old program, the program reuses the pages
+ * of the one before.
+ *
+ * Returns FALSE if the file could not be loaded, cpu can then only be
+ * reset again or stopped
+ */
+int
+APEX_cpu_reset(APEX_CPU *cpu, const char *filename)
+{
+    APEX_Checkpoint start;
+
+    if (!cpu->arena)
+    {
+        return FALSE;
+    }
+
+    /* A new program may land where the old one was, so the translation
+     * cache cannot tell it was reloaded */
+    APEX_translation_flush(cpu);
+
+    memset(&start, 0, sizeof(start));
+    start.pc = 4000;
+    APEX_memory_init(&start.data_memory, FALSE);
+    if (!load_program(cpu, filename, &start.data_memory))
+    {
+        APEX_checkpoint_free(&start);
+        return FALSE;
+    }
+
+    APEX_cpu_start_at(cpu, &start);
+    APEX_checkpoint_free(&start);
+    cpu->stream_lost = FALSE;
+    cpu->handlers = insn_handlers;
+    return TRUE;
+}
+
+/*
+ * APEX CPU simulation loop
+ *
+ * Stages read their input latch from the current bank and write their output
+ * latch into the next bank, which becomes current at the end of the cycle, so
+ * no stage overwrites a latch before its consumer has read it. The remaining
+ * order is that of the same-cycle paths being modeled: writeback updates the
+ * register file in the first half of the cycle, and fetch takes decode's
+ * stall and execute's redirect.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+void APEX_cpu_run(APEX_CPU *cpu)
+{
+    //char user_prompt_val;
+    int halted = FALSE;
+    int status;
+
+    if (cpu->sample_period > 0)
+    {
+        run_sampled(cpu);
+        finish_run(cpu);
+        return;
+    }
+
+    if (cpu->interval_insns > 0)
+    {
+        APEX_interval_run(cpu);
+        finish_run(cpu);
+        return;
+    }
+
+    /* A run simulated before ends as it did then */
+    if (APEX_cache_lookup(cpu))
+    {
+        fprintf(stderr, "APEX_CPU: Result found in cache\n");
+        printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+               cpu->run_status == RUN_HALTED ? "Complete" : "Deadlocked",
+               cpu->clock, cpu->insn_completed);
+        finish_run(cpu);
+        return;
+    }
+
+    /* Fast-forward with the functional simulator, then hand the state to
+     * the pipeline */
+    if (cpu->fast_forward_insns > 0 || cpu->fast_forward_pc > 0)
+    {
+        status = APEX_functional_run(
+            cpu, cpu->fast_forward_insns > 0 ? cpu->fast_forward_insns : -1,
+            cpu->fast_forward_pc > 0 ? cpu->fast_forward_pc : -1);
+        halted = (status != RUN_RETIRED);
+
+        if (ENABLE_DEBUG_MESSAGES(cpu))
+        {
+            fprintf(stderr,
+                    "APEX_CPU: Fast-forwarded %d instructions to PC %d\n",
+                    cpu->insn_completed, cpu->pc);
+        }
+
+        if (status == RUN_HALTED)
+        {
+            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            cpu->run_status = RUN_HALTED;
+        }
+        else if (status == RUN_LEFT_CODE)
+        {
+            fprintf(stderr, "APEX_Error: The program left code memory at PC %d\n", cpu->pc);
+            printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+        }
+        else
+        {
+            start_pipeline_at_pc(cpu);
+        }
+    }
+
+    /* Goes on from the last run of an earlier version of the program where
+     * the two still run the same */
+    APEX_incremental_start(cpu);
+
+    /* The functional thread starts from the state the pipeline starts from,
+     * and runs ahead of it */
+    if (cpu->decoupled && !halted)
+    {
+        cpu->stream = APEX_stream_start(cpu);
+        if (!cpu->stream)
+        {
+            fprintf(stderr, "APEX_Error: Unable to start the functional thread\n");
+            return;
+        }
+        cpu->handlers = stream_handlers;
+    }
+
+    while (!halted)
+    {
+        /* Snapshots are taken between two cycles, a restored run goes on
+         * from here */
+        if (cpu->snapshot_file
+            && ((cpu->snapshot_cycle > 0 && cpu->clock == cpu->snapshot_cycle)
+                || (cpu->snapshot_every > 0 && cpu->clock > 0
+                    && cpu->clock % cpu->snapshot_every == 0)))
+        {
+            APEX_snapshot_save(cpu, cpu->snapshot_file);
+        }
+        if (cpu->incremental && cpu->clock > 0
+            && cpu->clock % cpu->incremental_every == 0)
+        {
+            APEX_incremental_checkpoint(cpu);
+        }
+
+        if (cpu->cycle_limit > 0 && cpu->clock >= cpu->cycle_limit)
+        {
+            printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            break;
+        }
+
+        if (ENABLE_DEBUG_MESSAGES(cpu))
+        {
+            printf("--------------------------------------------\n");
+            printf("Clock Cycle #: %d\n", cpu->clock);
+            printf("--------------------------------------------\n");
+        }
+
+        if (APEX_writeback(cpu))
+        {
+            /* Halt in writeback stage */
+            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            cpu->run_status = RUN_HALTED;
+            break;
+        }
+
+        APEX_memory(cpu);
+        APEX_execute(cpu);
+        APEX_decode(cpu);
+        APEX_fetch(cpu);
+        swap_latch_banks(cpu);
+        //print_reg_file(cpu);
+
+        if (cpu->stream_lost)
+        {
+            fprintf(stderr, "APEX_Error: Pipeline left the functional path at cycle %d\n", cpu->clock);
+            printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            break;
+        }
+
+        // if (cpu->single_step)
+        // {
+        //     printf("Press any key to advance CPU Clock or <q> to quit:\n");
+        //     scanf("%c", &user_prompt_val);
+
+        //     if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
+        //     {
+        //         printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+        //         break;
+        //     }
+        // }
+        cpu->clock++;
+
+        if (cpu->cycle_skipping && pipeline_quiescent(cpu))
+        {
+            /* There is no next event to jump the clock to, every remaining
+             * cycle is a stall */
+            printf("APEX_CPU: Simulation Deadlocked, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            cpu->run_status = RUN_DEADLOCKED;
+            break;
+        }
+    }
+    APEX_incremental_finish(cpu);
+    APEX_cache_store(cpu);
+    finish_run(cpu);
+
+    APEX_stream_stop(cpu->stream);
+    cpu->stream = NULL;
+    cpu->handlers = insn_handlers;
+}
+
+/*
+ * Prints the register file and data memory
+ */
+void APEX_cpu_display_state(const APEX_CPU *cpu)
+{
+    architectural_register_display(cpu);
+    if (cpu->display_diff)
+    {
+        display_changed_data_memory(cpu);
+    }
+    else
+    {
+        display_data_memory(cpu);
+    }
+}
+
+/*
+ * Runs the pipeline for up to n_cycles more cycles, a negative n_cycles
+ * being no limit, for a caller that drives the simulation itself. Nothing
+ * is printed besides the debug messages, and the fast-forward and
+ * decoupled options are left to APEX_cpu_run.
+ *
+ * Returns RUN_RETIRED while the program runs on, or RUN_HALTED or
+ * RUN_DEADLOCKED once it has ended, without running any further
+ */
+int
+APEX_cpu_step(APEX_CPU *cpu, int n_cycles)
+{
+    if (cpu->run_status == RUN_RETIRED)
+    {
+        cpu->run_status = run_pipeline(
+            cpu, -1,
+            (n_cycles < 0 || n_cycles > INT_MAX - cpu->clock)
+                ? -1
+                : cpu->clock + n_cycles);
+    }
+    return cpu->run_status;
+}
+
+/*
+ * Architectural state, for programs using the library. The PC is that of
+ * the next fetch while the pipeline runs
+ */
+int
+APEX_cpu_get_pc(const APEX_CPU *cpu)
+{
+    return cpu->pc;
+}
+
+int
+APEX_cpu_get_clock(const APEX_CPU *cpu)
+{
+    return cpu->clock;
+}
+
+int
+APEX_cpu_get_insn_completed(const APEX_CPU *cpu)
+{
+    return cpu->insn_completed;
+}
+
+int
+APEX_cpu_get_zero_flag(const APEX_CPU *cpu)
+{
+    return cpu->zero_flag;
+}
+
+/*
+ * Reads register reg into *value.
+ *
+ * Returns FALSE if there is no such register
+ */
+int
+APEX_cpu_get_reg(const APEX_CPU *cpu, int reg, int *value)
+{
+    if (reg < 0 || reg >= REG_FILE_SIZE)
+    {
+        return FALSE;
+    }
+
+    *value = cpu->regs[reg];
+    return TRUE;
+}
+
+/*
+ * Reads the data memory word at address into *value. Every address is in
+ * data memory, negative ones wrap around, and words never written are zero.
+ *
+ * Returns TRUE
+ */
+int
+APEX_cpu_get_memory(const APEX_CPU *cpu, int address, int *value)
+{
+    *value = APEX_memory_peek(&cpu->data_memory, address);
+    return TRUE;
+}
+
+
+/*
+ * Sets a command line option of the CPU, all of them taking an integer.
+ *
+ * Returns FALSE if there is no option of that name
+ */
+int
+APEX_cpu_set_option(APEX_CPU *cpu, const char *name, const char *value)
+{
+    static const struct
+    {
+        const char *name;
+        size_t offset;
+    } options[] = {
+        {"fastforward", offsetof(APEX_CPU, fast_forward_insns)},
+        {"fastforward_pc", offsetof(APEX_CPU, fast_forward_pc)},
+        {"jit", offsetof(APEX_CPU, jit_enabled)},
+        {"decoupled", offsetof(APEX_CPU, decoupled)},
+        {"sample_period", offsetof(APEX_CPU, sample_period)},
+        {"sample_warmup", offsetof(APEX_CPU, sample_warmup)},
+        {"sample_window", offsetof(APEX_CPU, sample_window)},
+        {"interval_insns", offsetof(APEX_CPU, interval_insns)},
+        {"interval_warmup", offsetof(APEX_CPU, interval_warmup)},
+        {"threads", offsetof(APEX_CPU, interval_threads)},
+        {"verify", offsetof(APEX_CPU, interval_verify)},
+        {"snapshot_cycle", offsetof(APEX_CPU, snapshot_cycle)},
+        {"snapshot_every", offsetof(APEX_CPU, snapshot_every)},
+        {"incremental_every", offsetof(APEX_CPU, incremental_every)},
+        {"debug", offsetof(APEX_CPU, debug_messages)},
+        {"display_state", offsetof(APEX_CPU, display)},
+        {"display_diff", offsetof(APEX_CPU, display_diff)},
+        {"huge_pages", offsetof(APEX_CPU, data_memory.huge_pages)},
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(options) / sizeof(options[0]); ++i)
+    {
+        if (strcmp(name, options[i].name) == 0)
+        {
+            *(int *)((char *)cpu + options[i].offset) = atoi(value);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Returns TRUE if the options set go together, printing what is wrong
+ * otherwise
+ */
+int
+APEX_cpu_options_valid(const APEX_CPU *cpu)
+{
+    if (cpu->sample_period > 0
+        && (cpu->sample_window <= 0 || cpu->sample_warmup < 0
+            || cpu->sample_period < cpu->sample_warmup + cpu->sample_window))
+    {
+        fprintf(stderr, "APEX_Error: The sampling period must hold the "
+                "warm-up and a non-empty window\n");
+        return FALSE;
+    }
+    if (cpu->incremental_dir
+        && (cpu->fast_forward_insns > 0 || cpu->fast_forward_pc > 0
+            || cpu->decoupled || cpu->sample_period > 0
+            || cpu->interval_insns > 0))
+    {
+        fprintf(stderr, "APEX_Error: The incremental mode runs the whole "
+                "program in the pipeline\n");
+        return FALSE;
+    }
+    if (cpu->incremental_dir && cpu->incremental_every <= 0)
+    {
+        fprintf(stderr, "APEX_Error: The incremental mode needs a positive "
+                "snapshot interval\n");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * This function deallocates APEX CPU.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+void APEX_cpu_stop(APEX_CPU *cpu)
+{
+    APEX_translation_flush(cpu);
+    APEX_memory_free(&cpu->data_memory);
+    free_program(cpu);
+    APEX_arena_destroy(cpu->arena);
+}
\ No newline at end of file
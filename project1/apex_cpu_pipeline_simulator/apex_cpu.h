@@ -0,0 +1,358 @@
+/*
+ * apex_cpu.h
+ * Contains APEX cpu pipeline declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_CPU_H_
+#define _APEX_CPU_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "apex_macros.h"
+
+/* Format of an APEX instruction in code memory, 8 bytes
+ *
+ * The mnemonic is not stored per instruction, see get_opcode_mnemonic */
+typedef struct APEX_Instruction
+{
+    int imm;
+    unsigned char opcode;
+    unsigned char rd;
+    unsigned char rs1;
+    unsigned char rs2;
+} APEX_Instruction;
+
+/* Start of a binary program image written by apex_asm, followed by
+ * num_insns instructions as they are in code memory and num_data words of
+ * initial data memory, all in the byte order of the host */
+typedef struct APEX_Image_Header
+{
+    char magic[8];                 /* APEX_IMAGE_MAGIC */
+    unsigned int version;          /* APEX_IMAGE_VERSION */
+    unsigned int num_insns;
+    unsigned int num_data;         /* Words from data memory address 0 */
+    unsigned int reserved;
+} APEX_Image_Header;
+
+/* Start of a final-state dump written by APEX_dump_save, followed by
+ * num_pages APEX_Dump_Page by increasing page number. Pages that are not in
+ * the dump hold zeros. In the byte order of the host */
+typedef struct APEX_Dump_Header
+{
+    char magic[8];                 /* APEX_DUMP_MAGIC */
+    unsigned int version;          /* APEX_DUMP_VERSION */
+    unsigned int num_pages;
+    int pc;
+    int clock;
+    int insn_completed;
+    int zero_flag;
+    unsigned int regs_pending;     /* Registers shown as INVALID */
+    int regs[REG_FILE_SIZE];
+} APEX_Dump_Header;
+
+/* Data memory page of a dump */
+typedef struct APEX_Dump_Page
+{
+    unsigned int page;             /* Page number, the address over 1024 */
+    int words[DATA_PAGE_WORDS];
+} APEX_Dump_Page;
+
+/* Static dependency information of an instruction, built by the loader for
+ * every code memory slot */
+typedef struct APEX_Insn_Deps
+{
+    unsigned short src_mask;       /* Registers read in decode */
+    unsigned short dest_mask;      /* Registers written back */
+    unsigned char fu_class;        /* FU_* */
+    unsigned char flags;           /* INSN_* */
+} APEX_Insn_Deps;
+
+/* One instruction of the retire-order stream the functional simulator hands
+ * a decoupled timing model, see apex_stream.c */
+typedef struct APEX_Trace_Record
+{
+    int pc;
+    int value;                     /* Result written to rd, or word stored */
+    int memory_address;
+    unsigned char zero_flag;       /* Zero flag after the instruction */
+    unsigned char taken;           /* Branch redirected fetch */
+} APEX_Trace_Record;
+
+struct APEX_Page;
+struct APEX_Memory_Chunk;
+
+/* Sparse data memory over every 32-bit word address, see apex_memory.c.
+ * Pages are mapped in when first written, and read as zeros until then */
+typedef struct APEX_Memory
+{
+    unsigned int last_page;        /* Page number of last_words, or DATA_NO_PAGE */
+    int *last_words;               /* Page accessed last */
+    unsigned int store_page;       /* Page number of store_words, or DATA_NO_PAGE */
+    int *store_words;              /* Dirty page stored to last */
+    struct APEX_Page **directory;  /* Page tables by the top address bits */
+    struct APEX_Memory_Chunk *chunks; /* Mappings pages are taken from */
+    int num_chunks;
+    int chunk_capacity;
+    int *chunk_next;               /* Next page of the last chunk */
+    int chunk_pages_left;          /* Pages of the last chunk not yet used */
+    int num_pages;                 /* Pages mapped in */
+    int num_clean;                 /* Copies kept of dirtied pages */
+    int huge_pages;                /* Map chunks of huge pages */
+} APEX_Memory;
+
+/* Architectural state of an APEX_CPU between two instructions, enough to
+ * start the pipeline from. Its data memory is a copy with pages of its own,
+ * see APEX_checkpoint_free */
+typedef struct APEX_Checkpoint
+{
+    int pc;
+    int insn_completed;
+    int zero_flag;
+    unsigned int regs_written;
+    int regs[REG_FILE_SIZE];
+    APEX_Memory data_memory;
+} APEX_Checkpoint;
+
+struct APEX_CPU;
+struct APEX_Block;
+struct APEX_Incremental;
+
+/* Functional thread feeding a timing model, see apex_stream.c */
+typedef struct APEX_Stream APEX_Stream;
+
+/* Memory a CPU and its program are allocated from, see apex_arena.c */
+typedef struct APEX_Arena APEX_Arena;
+
+/* Instances simulated in lockstep, see apex_batch.c */
+typedef struct APEX_Batch APEX_Batch;
+struct CPU_Stage;
+
+/* Native code of a translated block, see APEX_jit_compile */
+typedef int (*APEX_Native_Block)(struct APEX_CPU *cpu);
+
+/* Work done by one pipeline stage for one instruction */
+typedef void (*APEX_Stage_Handler)(struct APEX_CPU *cpu,
+                                   struct CPU_Stage *stage,
+                                   const APEX_Instruction *insn);
+
+/* Stage handlers of one opcode */
+typedef struct APEX_Opcode_Handlers
+{
+    APEX_Stage_Handler decode;
+    APEX_Stage_Handler execute;
+    APEX_Stage_Handler memory;
+    APEX_Stage_Handler writeback;
+} APEX_Opcode_Handlers;
+
+/* Model of CPU stage latch
+ *
+ * Static instruction fields stay in code memory, a latch only carries the
+ * code memory index of its instruction and the values computed for it */
+typedef struct CPU_Stage
+{
+    int pc;
+    int insn;                      /* Code memory index of the instruction */
+    int rs1_value;
+    int rs2_value;
+    int result_buffer;
+    int memory_address;
+    unsigned char has_insn;
+    unsigned char stage_stalling;
+} CPU_Stage;
+
+/* Pipeline registers between the stages */
+typedef struct CPU_Latches
+{
+    CPU_Stage decode;
+    CPU_Stage execute;
+    CPU_Stage memory;
+    CPU_Stage writeback;
+} CPU_Latches;
+
+/* Model of APEX CPU */
+typedef struct APEX_CPU
+{
+    int pc;                        /* Current program counter */
+    int clock;                     /* Clock cycles elapsed */
+    int insn_completed;            /* Instructions retired */
+    int regs[REG_FILE_SIZE];       /* Integer register file */
+    unsigned int regs_pending;     /* Bit per register waiting for writeback */
+    int code_memory_size;          /* Number of instruction in the input file */
+    int cycle_limit;               /* Cycles to stop at, none if not positive */
+#if APEX_FORWARDING
+    int data_forward_buffer[REG_FILE_SIZE];
+    unsigned int data_forward_valid; /* Bit per register with a forwarded value */
+#endif
+    APEX_Instruction *code_memory; /* Code Memory */
+    APEX_Insn_Deps *code_deps;     /* Dependency info per code memory slot */
+    int code_memory_slots;         /* Code memory slots, padding included */
+    APEX_Memory data_memory;       /* Data Memory */
+    int single_step;               /* Wait for user input after every cycle */
+    int cycle_skipping;            /* Skip cycles in which no latch can change */
+    int decode_stall_cycles;       /* Cycles decode held an instruction */
+    int fetch_stall_cycles;        /* Cycles fetch handed decode nothing new */
+    int zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
+    int fetch_from_next_cycle;
+    int fast_forward_insns;        /* Instructions to run functionally first */
+    int fast_forward_pc;           /* PC to run functionally up to */
+    unsigned int regs_written;     /* Bit per register written functionally */
+    struct APEX_Block **block_cache; /* Translated block per code memory slot */
+    const APEX_Instruction *block_cache_code; /* Code memory translated */
+    int jit_enabled;               /* Compile translated blocks to native code */
+    unsigned char *jit_code;       /* Executable buffer of the native code */
+    int jit_code_used;             /* Bytes of jit_code in use */
+    int decoupled;                 /* Take values from a functional thread */
+    APEX_Stream *stream;           /* Functional thread, if decoupled */
+    int stream_lost;               /* Pipeline left the functional path */
+    const APEX_Opcode_Handlers *handlers; /* Stage handlers by opcode */
+    int sample_period;             /* Instructions per sample, 0 runs in full */
+    int sample_warmup;             /* Detailed instructions before measuring */
+    int sample_window;             /* Detailed instructions measured */
+    int interval_insns;            /* Instructions per interval, 0 runs in full */
+    int interval_warmup;           /* Detailed instructions before each */
+    int interval_threads;          /* Threads simulating intervals */
+    int interval_verify;           /* Also run in full, to report the error */
+    int run_status;                /* RUN_* once APEX_cpu_run returns */
+    int debug_messages;            /* Print every stage, as display does */
+    int display;                   /* Print the state once the run is over */
+    const char *snapshot_file;     /* Where snapshots are saved, if at all */
+    const char *dump_file;         /* Where the final state is dumped, if at all */
+    int display_diff;              /* Show only the memory words the run changed */
+    const char *cache_dir;         /* Result cache directory, if any */
+    int cache_keyed;               /* cache_key is that of this run */
+    unsigned long long cache_key[2]; /* Of the program, state and options */
+    int snapshot_cycle;            /* Cycle to save a snapshot at, 0 for none */
+    int snapshot_every;            /* Cycles between snapshots, 0 for none */
+    const char *incremental_dir;   /* Snapshots of the last run, if kept */
+    int incremental_every;         /* Cycles between those snapshots */
+    struct APEX_Incremental *incremental; /* Record of this run, if kept */
+    int *first_fetch;              /* Cycle each slot was first fetched at */
+    APEX_Arena *arena;             /* Holds the CPU, NULL for a plain copy */
+    size_t arena_mark;             /* End of the CPU, the program follows */
+    /* Fetch unit */
+    CPU_Stage fetch;
+    /* Pipeline stages, double buffered */
+    CPU_Latches latch_bank[2];
+    CPU_Latches *cur_latches;      /* Latches read this cycle */
+    CPU_Latches *next_latches;     /* Latches written this cycle */
+} APEX_CPU;
+
+APEX_Instruction *create_code_memory(const char *filename, int *size,
+                                     APEX_Arena *arena,
+                                     APEX_Memory *data_memory);
+void parse_instruction(APEX_Instruction *ins, const char *line);
+int find_opcode(const char *opcode_str);
+APEX_Insn_Deps *create_insn_deps(const APEX_Instruction *code_memory,
+                                 int size, APEX_Arena *arena);
+const char *get_opcode_mnemonic(int opcode);
+APEX_CPU * APEX_cpu_init(const char *filename, const char *keywords,const int cycles);
+void APEX_cpu_run(APEX_CPU *cpu);
+int APEX_cpu_reset(APEX_CPU *cpu, const char *filename);
+void APEX_cpu_stop(APEX_CPU *cpu);
+void APEX_cpu_display_state(const APEX_CPU *cpu);
+int APEX_cpu_step(APEX_CPU *cpu, int n_cycles);
+int APEX_cpu_get_pc(const APEX_CPU *cpu);
+int APEX_cpu_get_clock(const APEX_CPU *cpu);
+int APEX_cpu_get_insn_completed(const APEX_CPU *cpu);
+int APEX_cpu_get_zero_flag(const APEX_CPU *cpu);
+int APEX_cpu_get_reg(const APEX_CPU *cpu, int reg, int *value);
+int APEX_cpu_get_memory(const APEX_CPU *cpu, int address, int *value);
+int APEX_cpu_set_option(APEX_CPU *cpu, const char *name, const char *value);
+int APEX_cpu_options_valid(const APEX_CPU *cpu);
+int APEX_cpu_run_insns(APEX_CPU *cpu, int insns);
+int APEX_cpu_run_cycles(APEX_CPU *cpu, int max_cycles);
+void APEX_checkpoint_save(const APEX_CPU *cpu, APEX_Checkpoint *checkpoint);
+void APEX_checkpoint_free(APEX_Checkpoint *checkpoint);
+void APEX_cpu_start_at(APEX_CPU *cpu, const APEX_Checkpoint *checkpoint);
+void APEX_cpu_restart(APEX_CPU *cpu);
+int APEX_functional_step(APEX_CPU *cpu);
+int APEX_functional_run(APEX_CPU *cpu, int max_insns, int stop_pc);
+int APEX_functional_trace(APEX_CPU *cpu, APEX_Trace_Record *record);
+void APEX_translation_flush(APEX_CPU *cpu);
+APEX_Native_Block APEX_jit_compile(APEX_CPU *cpu, int start, int count);
+void APEX_jit_free(APEX_CPU *cpu);
+APEX_Arena *APEX_arena_create(size_t size, int huge_pages);
+void *APEX_arena_alloc(APEX_Arena *arena, size_t bytes);
+int APEX_arena_owns(const APEX_Arena *arena, const void *memory);
+size_t APEX_arena_mark(const APEX_Arena *arena);
+void APEX_arena_release(APEX_Arena *arena, size_t mark);
+void APEX_arena_destroy(APEX_Arena *arena);
+void APEX_memory_init(APEX_Memory *memory, int huge_pages);
+void APEX_memory_free(APEX_Memory *memory);
+void APEX_memory_copy(APEX_Memory *dest, const APEX_Memory *src);
+const int *APEX_memory_page(const APEX_Memory *memory, unsigned int page);
+const int *APEX_memory_clean_page(const APEX_Memory *memory,
+                                  unsigned int page);
+unsigned int APEX_memory_next_page(const APEX_Memory *memory,
+                                   unsigned int page);
+unsigned int APEX_memory_next_dirty_page(const APEX_Memory *memory,
+                                         unsigned int page);
+void APEX_memory_mark_clean(APEX_Memory *memory);
+void APEX_memory_put_page(APEX_Memory *memory, unsigned int page,
+                          const int *words, int kind);
+int APEX_memory_map_image(APEX_Memory *memory, const char *filename,
+                          unsigned int base);
+int APEX_memory_peek(const APEX_Memory *memory, unsigned int address);
+int APEX_memory_load_miss(APEX_Memory *memory, unsigned int address);
+int *APEX_memory_touch(APEX_Memory *memory, unsigned int address);
+int APEX_snapshot_save(const APEX_CPU *cpu, const char *filename);
+int APEX_snapshot_restore(APEX_CPU *cpu, const char *filename);
+int APEX_snapshot_resume(APEX_CPU *cpu, const char *filename,
+                         unsigned long long code_hash);
+unsigned long long APEX_snapshot_code_hash(const APEX_CPU *cpu);
+int APEX_dump_write(const APEX_CPU *cpu, FILE *fp);
+int APEX_dump_save(const APEX_CPU *cpu, const char *filename);
+int APEX_dump_apply(APEX_CPU *cpu, const void *data, size_t size);
+int APEX_cache_lookup(APEX_CPU *cpu);
+void APEX_cache_store(const APEX_CPU *cpu);
+void APEX_cache_key(const APEX_CPU *cpu, int with_code,
+                    unsigned long long key[2]);
+int APEX_incremental_start(APEX_CPU *cpu);
+void APEX_incremental_checkpoint(APEX_CPU *cpu);
+void APEX_incremental_finish(APEX_CPU *cpu);
+APEX_Batch *APEX_batch_init(const char *const *filenames, int num_instances);
+void APEX_batch_run(APEX_Batch *batch, int max_cycles);
+void APEX_batch_report(const APEX_Batch *batch);
+void APEX_batch_stop(APEX_Batch *batch);
+APEX_Stream *APEX_stream_start(const APEX_CPU *cpu);
+int APEX_stream_next(APEX_Stream *stream, APEX_Trace_Record *record);
+void APEX_stream_stop(APEX_Stream *stream);
+void APEX_interval_run(APEX_CPU *cpu);
+void APEX_sweep_run(APEX_CPU *cpu, const char *const *configs,
+                    int num_configs);
+int APEX_manifest_run(const char *manifest, const char *results,
+                      int num_threads);
+
+/*
+ * Loads the word at address. Inline for the page accessed last, which is
+ * what LOAD and LDR hit nearly every time
+ */
+static inline int
+APEX_memory_load(APEX_Memory *memory, unsigned int address)
+{
+    if (address >> DATA_PAGE_SHIFT == memory->last_page)
+    {
+        return memory->last_words[address & DATA_PAGE_MASK];
+    }
+    return APEX_memory_load_miss(memory, address);
+}
+
+/*
+ * Stores value at address. Inline for the dirty page stored to last, any
+ * other page is dirtied first
+ */
+static inline void
+APEX_memory_store(APEX_Memory *memory, unsigned int address, int value)
+{
+    if (address >> DATA_PAGE_SHIFT == memory->store_page)
+    {
+        memory->store_words[address & DATA_PAGE_MASK] = value;
+        return;
+    }
+    *APEX_memory_touch(memory, address) = value;
+}
+#endif
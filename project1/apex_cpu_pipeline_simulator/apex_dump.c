@@ -0,0 +1,219 @@
+/*
+ * apex_dump.c
+ * Contains final-state dumps: the register file, the zero flag and every
+ * data memory page that is not all zeros, written in binary to a file for
+ * apex_cmp to compare instead of being printed, and read back by the
+ * result cache
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/*
+ * Writes the data memory pages of cpu that are not all zeros after the
+ * dump header.
+ *
+ * Returns the number of pages written, -1 if not all of them could be
+ */
+static int
+write_pages(const APEX_CPU *cpu, FILE *fp)
+{
+    static const int zeros[DATA_PAGE_WORDS];
+    const int *words;
+    unsigned int page;
+    int pages = 0;
+
+    for (page = APEX_memory_next_page(&cpu->data_memory, 0);
+         page != DATA_NO_PAGE;
+         page = APEX_memory_next_page(&cpu->data_memory, page + 1))
+    {
+        words = APEX_memory_page(&cpu->data_memory, page);
+        if (memcmp(words, zeros, sizeof(zeros)) == 0)
+        {
+            continue;
+        }
+        if (fwrite(&page, sizeof(page), 1, fp) != 1
+            || fwrite(words, sizeof(int), DATA_PAGE_WORDS, fp)
+                   != DATA_PAGE_WORDS)
+        {
+            return -1;
+        }
+        pages++;
+    }
+    return pages;
+}
+
+/*
+ * Writes the final state of cpu to fp as a dump, see APEX_Dump_Header
+ *
+ * Returns FALSE if not all of it could be written
+ */
+int
+APEX_dump_write(const APEX_CPU *cpu, FILE *fp)
+{
+    APEX_Dump_Header header;
+    long start = ftell(fp);
+    int pages;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, APEX_DUMP_MAGIC, sizeof(APEX_DUMP_MAGIC));
+    header.version = APEX_DUMP_VERSION;
+    header.pc = cpu->pc;
+    header.clock = cpu->clock;
+    header.insn_completed = cpu->insn_completed;
+    header.zero_flag = cpu->zero_flag;
+    header.regs_pending = cpu->regs_pending;
+    memcpy(header.regs, cpu->regs, sizeof(header.regs));
+
+    /* The header is written again once the pages are counted */
+    if (start < 0 || fwrite(&header, sizeof(header), 1, fp) != 1)
+    {
+        return FALSE;
+    }
+    pages = write_pages(cpu, fp);
+    if (pages < 0)
+    {
+        return FALSE;
+    }
+    header.num_pages = pages;
+    return fseek(fp, start, SEEK_SET) == 0
+           && fwrite(&header, sizeof(header), 1, fp) == 1
+           && fseek(fp, 0, SEEK_END) == 0;
+}
+
+/*
+ * Dumps the final state of cpu to filename. As with snapshots, the file is
+ * written beside filename and renamed over it.
+ *
+ * Returns FALSE if the file could not be written
+ */
+int
+APEX_dump_save(const APEX_CPU *cpu, const char *filename)
+{
+    char temp[4096];
+    FILE *fp;
+    int written;
+
+    if (snprintf(temp, sizeof(temp), "%s.tmp", filename) >= (int)sizeof(temp))
+    {
+        fprintf(stderr, "APEX_Error: Dump file name too long\n");
+        return FALSE;
+    }
+
+    fp = fopen(temp, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write dump %s\n", temp);
+        return FALSE;
+    }
+
+    written = APEX_dump_write(cpu, fp);
+    if (fclose(fp) != 0 || !written || rename(temp, filename) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write dump %s\n", filename);
+        unlink(temp);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Sets the words of page number page of data memory to words, storing only
+ * those that differ, so that pages left as they were stay clean
+ */
+static void
+set_page(APEX_Memory *memory, unsigned int page, const int *words)
+{
+    static const int zeros[DATA_PAGE_WORDS];
+    const int *current = APEX_memory_page(memory, page);
+    unsigned int address = page << DATA_PAGE_SHIFT;
+    int i;
+
+    if (!current)
+    {
+        current = zeros;
+    }
+    if (memcmp(current, words, sizeof(zeros)) == 0)
+    {
+        return;
+    }
+    for (i = 0; i < DATA_PAGE_WORDS; i++)
+    {
+        if (current[i] != words[i])
+        {
+            APEX_memory_store(memory, address | i, words[i]);
+        }
+    }
+}
+
+/*
+ * Brings cpu, which holds the program the dump of size bytes at data was
+ * taken running, to the final state in the dump. Data memory is stored to
+ * where it differs, so it is dirty where the run changed it.
+ *
+ * Returns FALSE if data is not a whole dump
+ */
+int
+APEX_dump_apply(APEX_CPU *cpu, const void *data, size_t size)
+{
+    static const int zeros[DATA_PAGE_WORDS];
+    const APEX_Dump_Header *header = data;
+    const APEX_Dump_Page *pages = (const APEX_Dump_Page *)(header + 1);
+    unsigned int page;
+    unsigned int i;
+
+    if (size < sizeof(*header)
+        || memcmp(header->magic, APEX_DUMP_MAGIC, sizeof(APEX_DUMP_MAGIC)) != 0
+        || header->version != APEX_DUMP_VERSION
+        || header->num_pages > DATA_NUM_PAGES
+        || size != sizeof(*header) + header->num_pages * sizeof(*pages))
+    {
+        return FALSE;
+    }
+    for (i = 1; i < header->num_pages; i++)
+    {
+        if (pages[i].page <= pages[i - 1].page)
+        {
+            return FALSE;
+        }
+    }
+    if (header->num_pages && pages[header->num_pages - 1].page >= DATA_NUM_PAGES)
+    {
+        return FALSE;
+    }
+
+    cpu->pc = header->pc;
+    cpu->clock = header->clock;
+    cpu->insn_completed = header->insn_completed;
+    cpu->zero_flag = header->zero_flag;
+    cpu->regs_pending = header->regs_pending;
+    memcpy(cpu->regs, header->regs, sizeof(cpu->regs));
+
+    /* Pages of memory missing from the dump end up as zeros */
+    i = 0;
+    for (page = APEX_memory_next_page(&cpu->data_memory, 0);
+         page != DATA_NO_PAGE;
+         page = APEX_memory_next_page(&cpu->data_memory, page + 1))
+    {
+        while (i < header->num_pages && pages[i].page < page)
+        {
+            i++;
+        }
+        if (i == header->num_pages || pages[i].page != page)
+        {
+            set_page(&cpu->data_memory, page, zeros);
+        }
+    }
+    for (i = 0; i < header->num_pages; i++)
+    {
+        set_page(&cpu->data_memory, pages[i].page, pages[i].words);
+    }
+    return TRUE;
+}
@@ -0,0 +1,814 @@
+/*
+ * apex_functional.c
+ * Contains the functional (instruction set only) APEX simulator, used to
+ * fast-forward a program before handing its state to the pipeline
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* How a translated block ends */
+#define BLOCK_EXIT_FALLTHROUGH 0x0 /* Ran into the end of code memory */
+#define BLOCK_EXIT_BZ 0x1
+#define BLOCK_EXIT_BNZ 0x2
+#define BLOCK_EXIT_CMP 0x3
+#define BLOCK_EXIT_HALT 0x4
+
+/* Outcome of running a translated block */
+#define BLOCK_RAN 0x0
+#define BLOCK_HALTED 0x1
+#define BLOCK_SIDE_EXIT 0x2 /* Native code left an instruction to step */
+
+typedef struct APEX_Uop APEX_Uop;
+typedef void (*APEX_Uop_Fn)(APEX_CPU *cpu, const APEX_Uop *uop);
+
+/* Micro-op of a translated block: the handler of one instruction, or of a
+ * fused pair, with its operands bound in */
+struct APEX_Uop
+{
+    APEX_Uop_Fn fn;
+    int imm;
+    int imm2;                      /* Second instruction of a fused pair */
+    unsigned char rd;
+    unsigned char rs1;
+    unsigned char rs2;
+    unsigned char rd2;             /* Second instruction of a fused pair */
+    unsigned char rs1_2;           /* Second instruction of a fused pair */
+};
+
+/* Straight-line run of instructions ending in BZ, BNZ, CMP or HALT, CMP
+ * being a branch through its fall-through into BZ */
+typedef struct APEX_Block
+{
+    int pc;                        /* PC of the first instruction */
+    int num_insns;                 /* Instructions, exit included */
+    int num_uops;
+    int exit;                      /* BLOCK_EXIT_* */
+    unsigned char cmp_rs1;
+    unsigned char cmp_rs2;
+    unsigned int regs_written;     /* Registers written by the block */
+    int taken_pc;
+    int fallthrough_pc;
+    /* Chained successors, looked up the first time each exit is taken */
+    struct APEX_Block *taken;
+    struct APEX_Block *fallthrough;
+    APEX_Native_Block native;      /* Native code of the uops, if compiled */
+    APEX_Uop uops[];
+} APEX_Block;
+
+/* Writes rd and records it for the hand-off to the pipeline */
+static inline void
+write_rd(APEX_CPU *cpu, const APEX_Instruction *insn, int value)
+{
+    cpu->regs[insn->rd] = value;
+    cpu->regs_written |= 1u << insn->rd;
+}
+
+/*
+ * Returns TRUE if pc falls on an instruction of the program, the padding
+ * slots after it excluded. A pc off a word boundary runs the instruction
+ * of its word, as the pipeline fetches it
+ */
+static inline int
+in_code_memory(const APEX_CPU *cpu, int pc)
+{
+    return pc >= 4000 && ((pc - 4000) >> 2) < cpu->code_memory_size;
+}
+
+/*
+ * Executes the instruction at cpu->pc with no pipeline modeling, using the
+ * same register file, data memory and zero flag as the pipeline.
+ *
+ * Returns RUN_HALTED once HALT is executed, RUN_LEFT_CODE without executing
+ * anything if cpu->pc is past the program, RUN_RETIRED otherwise
+ */
+int
+APEX_functional_step(APEX_CPU *cpu)
+{
+    const APEX_Instruction *insn;
+    int *regs = cpu->regs;
+    int result;
+    int next_pc = cpu->pc + 4;
+
+    if (!in_code_memory(cpu, cpu->pc))
+    {
+        return RUN_LEFT_CODE;
+    }
+    insn = &cpu->code_memory[(cpu->pc - 4000) >> 2];
+
+    switch (insn->opcode)
+    {
+        case OPCODE_ADD:
+        {
+            result = regs[insn->rs1] + regs[insn->rs2];
+            write_rd(cpu, insn, result);
+            cpu->zero_flag = (result == 0);
+            break;
+        }
+
+        case OPCODE_SUB:
+        {
+            result = regs[insn->rs1] - regs[insn->rs2];
+            write_rd(cpu, insn, result);
+            cpu->zero_flag = (result == 0);
+            break;
+        }
+
+        case OPCODE_MUL:
+        {
+            result = regs[insn->rs1] * regs[insn->rs2];
+            write_rd(cpu, insn, result);
+            cpu->zero_flag = (result == 0);
+            break;
+        }
+
+        case OPCODE_DIV:
+        {
+            result = regs[insn->rs1] / regs[insn->rs2];
+            write_rd(cpu, insn, result);
+            cpu->zero_flag = (result == 0);
+            break;
+        }
+
+        case OPCODE_AND:
+        {
+            result = regs[insn->rs1] & regs[insn->rs2];
+            write_rd(cpu, insn, result);
+            cpu->zero_flag = (result == 0);
+            break;
+        }
+
+        case OPCODE_OR:
+        {
+            result = regs[insn->rs1] | regs[insn->rs2];
+            write_rd(cpu, insn, result);
+            cpu->zero_flag = (result == 0);
+            break;
+        }
+
+        case OPCODE_XOR:
+        {
+            result = regs[insn->rs1] ^ regs[insn->rs2];
+            write_rd(cpu, insn, result);
+            cpu->zero_flag = (result == 0);
+            break;
+        }
+
+        case OPCODE_MOVC:
+        {
+            write_rd(cpu, insn, insn->imm);
+            cpu->zero_flag = (insn->imm == 0);
+            break;
+        }
+
+        case OPCODE_ADDL:
+        {
+            write_rd(cpu, insn, regs[insn->rs1] + insn->imm);
+            break;
+        }
+
+        case OPCODE_SUBL:
+        {
+            write_rd(cpu, insn, regs[insn->rs1] - insn->imm);
+            break;
+        }
+
+        case OPCODE_LOAD:
+        {
+            write_rd(cpu, insn,
+                     APEX_memory_load(&cpu->data_memory,
+                                      regs[insn->rs1] + insn->imm));
+            break;
+        }
+
+        case OPCODE_LDR:
+        {
+            write_rd(cpu, insn,
+                     APEX_memory_load(&cpu->data_memory,
+                                      regs[insn->rs1] + regs[insn->rs2]));
+            break;
+        }
+
+        case OPCODE_STORE:
+        {
+            APEX_memory_store(&cpu->data_memory, regs[insn->rs1] + insn->imm,
+                              regs[insn->rd]);
+            break;
+        }
+
+        case OPCODE_STR:
+        {
+            APEX_memory_store(&cpu->data_memory,
+                              regs[insn->rs1] + regs[insn->rs2],
+                              regs[insn->rd]);
+            break;
+        }
+
+        case OPCODE_CMP:
+        {
+            /* CMP continues into the BZ redirect, as in the pipeline */
+            cpu->zero_flag = (regs[insn->rs1] == regs[insn->rs2]);
+            if (cpu->zero_flag)
+            {
+                next_pc = cpu->pc + insn->imm;
+            }
+            break;
+        }
+
+        case OPCODE_BZ:
+        {
+            if (cpu->zero_flag)
+            {
+                next_pc = cpu->pc + insn->imm;
+            }
+            break;
+        }
+
+        case OPCODE_BNZ:
+        {
+            if (!cpu->zero_flag)
+            {
+                next_pc = cpu->pc + insn->imm;
+            }
+            break;
+        }
+
+        case OPCODE_HALT:
+        {
+            cpu->insn_completed++;
+            return RUN_HALTED;
+        }
+    }
+
+    cpu->pc = next_pc;
+    cpu->insn_completed++;
+    return RUN_RETIRED;
+}
+
+/*
+ * Executes the instruction at cpu->pc as APEX_functional_step does, and
+ * describes it in record for a timing model
+ *
+ * Returns what APEX_functional_step does, record is only filled for
+ * RUN_RETIRED
+ */
+int
+APEX_functional_trace(APEX_CPU *cpu, APEX_Trace_Record *record)
+{
+    int index = (cpu->pc - 4000) >> 2;
+    const APEX_Instruction *insn;
+    const APEX_Insn_Deps *deps;
+    const int *regs = cpu->regs;
+    int status;
+
+    if (!in_code_memory(cpu, cpu->pc))
+    {
+        return RUN_LEFT_CODE;
+    }
+    insn = &cpu->code_memory[index];
+    deps = &cpu->code_deps[index];
+
+    record->pc = cpu->pc;
+    if (insn->opcode == OPCODE_STR || insn->opcode == OPCODE_LDR)
+    {
+        record->memory_address = regs[insn->rs1] + regs[insn->rs2];
+    }
+    else
+    {
+        record->memory_address = regs[insn->rs1] + insn->imm;
+    }
+
+    /* The word a store writes, before the instruction runs */
+    record->value = regs[insn->rd];
+
+    status = APEX_functional_step(cpu);
+    if (status != RUN_RETIRED)
+    {
+        return status;
+    }
+
+    if (deps->dest_mask)
+    {
+        record->value = regs[insn->rd];
+    }
+    record->zero_flag = cpu->zero_flag;
+
+    /* Taken even when the target is the next instruction, the pipeline
+     * still redirects fetch */
+    record->taken = FALSE;
+    if (deps->flags & INSN_BRANCH)
+    {
+        record->taken = (insn->opcode == OPCODE_BNZ) ? !cpu->zero_flag
+                                                     : cpu->zero_flag;
+    }
+    return RUN_RETIRED;
+}
+
+static void
+uop_add(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    int result = cpu->regs[uop->rs1] + cpu->regs[uop->rs2];
+
+    cpu->regs[uop->rd] = result;
+    cpu->zero_flag = (result == 0);
+}
+
+static void
+uop_sub(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    int result = cpu->regs[uop->rs1] - cpu->regs[uop->rs2];
+
+    cpu->regs[uop->rd] = result;
+    cpu->zero_flag = (result == 0);
+}
+
+static void
+uop_mul(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    int result = cpu->regs[uop->rs1] * cpu->regs[uop->rs2];
+
+    cpu->regs[uop->rd] = result;
+    cpu->zero_flag = (result == 0);
+}
+
+static void
+uop_div(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    int result = cpu->regs[uop->rs1] / cpu->regs[uop->rs2];
+
+    cpu->regs[uop->rd] = result;
+    cpu->zero_flag = (result == 0);
+}
+
+static void
+uop_and(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    int result = cpu->regs[uop->rs1] & cpu->regs[uop->rs2];
+
+    cpu->regs[uop->rd] = result;
+    cpu->zero_flag = (result == 0);
+}
+
+static void
+uop_or(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    int result = cpu->regs[uop->rs1] | cpu->regs[uop->rs2];
+
+    cpu->regs[uop->rd] = result;
+    cpu->zero_flag = (result == 0);
+}
+
+static void
+uop_xor(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    int result = cpu->regs[uop->rs1] ^ cpu->regs[uop->rs2];
+
+    cpu->regs[uop->rd] = result;
+    cpu->zero_flag = (result == 0);
+}
+
+static void
+uop_movc(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    cpu->regs[uop->rd] = uop->imm;
+    cpu->zero_flag = (uop->imm == 0);
+}
+
+static void
+uop_addl(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    cpu->regs[uop->rd] = cpu->regs[uop->rs1] + uop->imm;
+}
+
+static void
+uop_subl(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    cpu->regs[uop->rd] = cpu->regs[uop->rs1] - uop->imm;
+}
+
+static void
+uop_load(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    cpu->regs[uop->rd] = APEX_memory_load(&cpu->data_memory,
+                                          cpu->regs[uop->rs1] + uop->imm);
+}
+
+static void
+uop_ldr(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    cpu->regs[uop->rd]
+        = APEX_memory_load(&cpu->data_memory,
+                           cpu->regs[uop->rs1] + cpu->regs[uop->rs2]);
+}
+
+static void
+uop_store(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    APEX_memory_store(&cpu->data_memory, cpu->regs[uop->rs1] + uop->imm,
+                      cpu->regs[uop->rd]);
+}
+
+static void
+uop_str(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    APEX_memory_store(&cpu->data_memory,
+                      cpu->regs[uop->rs1] + cpu->regs[uop->rs2],
+                      cpu->regs[uop->rd]);
+}
+
+/* Superinstruction: MOVC, MOVC */
+static void
+uop_movc_movc(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    cpu->regs[uop->rd] = uop->imm;
+    cpu->regs[uop->rd2] = uop->imm2;
+    cpu->zero_flag = (uop->imm2 == 0);
+}
+
+/* Superinstruction: ADDL or SUBL, twice */
+static void
+uop_addl_addl(APEX_CPU *cpu, const APEX_Uop *uop)
+{
+    cpu->regs[uop->rd] = cpu->regs[uop->rs1] + uop->imm;
+    cpu->regs[uop->rd2] = cpu->regs[uop->rs1_2] + uop->imm2;
+}
+
+/* Micro-op handler of every opcode that does not end a block */
+static const APEX_Uop_Fn uop_handlers[NUM_OPCODES] = {
+    [OPCODE_ADD] = uop_add,
+    [OPCODE_SUB] = uop_sub,
+    [OPCODE_MUL] = uop_mul,
+    [OPCODE_DIV] = uop_div,
+    [OPCODE_AND] = uop_and,
+    [OPCODE_OR] = uop_or,
+    [OPCODE_XOR] = uop_xor,
+    [OPCODE_MOVC] = uop_movc,
+    [OPCODE_LOAD] = uop_load,
+    [OPCODE_STORE] = uop_store,
+    [OPCODE_STR] = uop_str,
+    [OPCODE_LDR] = uop_ldr,
+    [OPCODE_ADDL] = uop_addl,
+    [OPCODE_SUBL] = uop_subl,
+};
+
+/*
+ * Fuses uop b into uop a when the pair has a superinstruction.
+ *
+ * Returns TRUE if b was fused
+ */
+static int
+fuse_uops(APEX_Uop *a, const APEX_Uop *b)
+{
+    if (a->fn == uop_movc && b->fn == uop_movc)
+    {
+        a->fn = uop_movc_movc;
+        a->rd2 = b->rd;
+        a->imm2 = b->imm;
+        return TRUE;
+    }
+
+    if ((a->fn == uop_addl || a->fn == uop_subl)
+        && (b->fn == uop_addl || b->fn == uop_subl)
+        && a->imm != INT_MIN && b->imm != INT_MIN)
+    {
+        a->imm = (a->fn == uop_subl) ? -a->imm : a->imm;
+        a->imm2 = (b->fn == uop_subl) ? -b->imm : b->imm;
+        a->fn = uop_addl_addl;
+        a->rd2 = b->rd;
+        a->rs1_2 = b->rs1;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Translates the block starting at code memory index start
+ */
+static APEX_Block *
+translate_block(APEX_CPU *cpu, int start)
+{
+    const APEX_Instruction *insn;
+    APEX_Block *block;
+    APEX_Uop uop;
+    int end;
+
+    /* Find the instruction ending the block */
+    for (end = start; end < cpu->code_memory_size; ++end)
+    {
+        if (cpu->code_deps[end].flags & (INSN_BRANCH | INSN_HALT))
+        {
+            break;
+        }
+    }
+
+    block = calloc(1, sizeof(APEX_Block) + (end - start) * sizeof(APEX_Uop));
+    if (!block)
+    {
+        return NULL;
+    }
+
+    block->pc = 4000 + (start << 2);
+    block->num_insns = end - start;
+
+    for (insn = &cpu->code_memory[start]; insn < &cpu->code_memory[end];
+         ++insn)
+    {
+        uop.fn = uop_handlers[insn->opcode];
+        uop.imm = insn->imm;
+        uop.rd = insn->rd;
+        uop.rs1 = insn->rs1;
+        uop.rs2 = insn->rs2;
+        block->regs_written |= cpu->code_deps[insn - cpu->code_memory].dest_mask;
+
+        if (block->num_uops == 0
+            || !fuse_uops(&block->uops[block->num_uops - 1], &uop))
+        {
+            block->uops[block->num_uops++] = uop;
+        }
+    }
+
+    if (cpu->jit_enabled && end > start)
+    {
+        /* Blocks the JIT cannot take stay with the uops */
+        block->native = APEX_jit_compile(cpu, start, end - start);
+    }
+
+    block->fallthrough_pc = 4000 + (end << 2);
+    if (end == cpu->code_memory_size)
+    {
+        block->exit = BLOCK_EXIT_FALLTHROUGH;
+        return block;
+    }
+
+    /* The exit instruction */
+    insn = &cpu->code_memory[end];
+    block->num_insns++;
+    block->taken_pc = block->fallthrough_pc + insn->imm;
+    block->fallthrough_pc += 4;
+
+    switch (insn->opcode)
+    {
+        case OPCODE_BZ:
+            block->exit = BLOCK_EXIT_BZ;
+            break;
+
+        case OPCODE_BNZ:
+            block->exit = BLOCK_EXIT_BNZ;
+            break;
+
+        case OPCODE_CMP:
+            block->exit = BLOCK_EXIT_CMP;
+            block->cmp_rs1 = insn->rs1;
+            block->cmp_rs2 = insn->rs2;
+            break;
+
+        default:
+            block->exit = BLOCK_EXIT_HALT;
+            break;
+    }
+
+    return block;
+}
+
+/*
+ * Drops every translated block, must be called whenever code memory is
+ * reloaded
+ */
+void
+APEX_translation_flush(APEX_CPU *cpu)
+{
+    int i;
+
+    if (cpu->block_cache)
+    {
+        for (i = 0; i < cpu->code_memory_slots; ++i)
+        {
+            free(cpu->block_cache[i]);
+        }
+        free(cpu->block_cache);
+    }
+    APEX_jit_free(cpu);
+
+    cpu->block_cache = NULL;
+    cpu->block_cache_code = NULL;
+}
+
+/*
+ * Returns the translated block starting at pc, translating it on first use,
+ * or NULL if pc is outside the program or out of memory
+ */
+static APEX_Block *
+lookup_block(APEX_CPU *cpu, int pc)
+{
+    int index = (pc - 4000) >> 2;
+
+    if (cpu->block_cache_code != cpu->code_memory)
+    {
+        /* Code memory was reloaded since the blocks were translated */
+        APEX_translation_flush(cpu);
+    }
+
+    if (!cpu->block_cache)
+    {
+        cpu->block_cache = calloc(cpu->code_memory_slots, sizeof(APEX_Block *));
+        if (!cpu->block_cache)
+        {
+            return NULL;
+        }
+        cpu->block_cache_code = cpu->code_memory;
+    }
+
+    if ((pc & 3) || !in_code_memory(cpu, pc))
+    {
+        return NULL;
+    }
+
+    if (!cpu->block_cache[index])
+    {
+        cpu->block_cache[index] = translate_block(cpu, index);
+    }
+
+    return cpu->block_cache[index];
+}
+
+/*
+ * Executes a translated block and moves cpu->pc past it. *status is set to
+ * one of BLOCK_RAN, BLOCK_HALTED or BLOCK_SIDE_EXIT, after which cpu->pc is
+ * the instruction native code left to the interpreter.
+ *
+ * Returns the chained successor block, NULL if it is not known
+ */
+static APEX_Block *
+run_block(APEX_CPU *cpu, APEX_Block *block, int *status)
+{
+    const APEX_Uop *uop;
+    int body = block->num_insns - (block->exit != BLOCK_EXIT_FALLTHROUGH);
+    int start;
+    int done;
+    int taken;
+    int i;
+
+    *status = BLOCK_RAN;
+
+    if (block->native)
+    {
+        done = block->native(cpu);
+        if (done < body)
+        {
+            start = (block->pc - 4000) >> 2;
+            for (i = 0; i < done; ++i)
+            {
+                cpu->regs_written |= cpu->code_deps[start + i].dest_mask;
+            }
+            cpu->insn_completed += done;
+            cpu->pc = block->pc + 4 * done;
+            *status = BLOCK_SIDE_EXIT;
+            return NULL;
+        }
+    }
+    else
+    {
+        for (uop = block->uops; uop < &block->uops[block->num_uops]; ++uop)
+        {
+            uop->fn(cpu, uop);
+        }
+    }
+
+    cpu->regs_written |= block->regs_written;
+    cpu->insn_completed += block->num_insns;
+
+    switch (block->exit)
+    {
+        case BLOCK_EXIT_HALT:
+            cpu->pc = block->fallthrough_pc - 4;
+            *status = BLOCK_HALTED;
+            return NULL;
+
+        case BLOCK_EXIT_CMP:
+            cpu->zero_flag
+                = (cpu->regs[block->cmp_rs1] == cpu->regs[block->cmp_rs2]);
+            taken = cpu->zero_flag;
+            break;
+
+        case BLOCK_EXIT_BZ:
+            taken = cpu->zero_flag;
+            break;
+
+        case BLOCK_EXIT_BNZ:
+            taken = !cpu->zero_flag;
+            break;
+
+        default:
+            taken = FALSE;
+            break;
+    }
+
+    if (taken)
+    {
+        cpu->pc = block->taken_pc;
+        if (!block->taken)
+        {
+            block->taken = lookup_block(cpu, block->taken_pc);
+        }
+        return block->taken;
+    }
+
+    cpu->pc = block->fallthrough_pc;
+    if (!block->fallthrough)
+    {
+        block->fallthrough = lookup_block(cpu, block->fallthrough_pc);
+    }
+    return block->fallthrough;
+}
+
+/*
+ * Runs the functional simulator until HALT, until max_insns instructions
+ * have been executed, or until cpu->pc reaches stop_pc, whichever comes
+ * first. A negative max_insns or stop_pc is no limit.
+ *
+ * Whole basic blocks are run from the translation cache, single steps are
+ * only used where a limit falls inside a block.
+ *
+ * Returns RUN_HALTED if the program halted, RUN_LEFT_CODE if it left code
+ * memory, RUN_RETIRED once a limit is reached
+ */
+int
+APEX_functional_run(APEX_CPU *cpu, int max_insns, int stop_pc)
+{
+    APEX_Block *block = NULL;
+    int completed;
+    int status;
+
+    while (max_insns != 0 && cpu->pc != stop_pc)
+    {
+        if (!block)
+        {
+            block = lookup_block(cpu, cpu->pc);
+        }
+
+        if (!block || cpu->pc != block->pc
+            || (max_insns > 0 && max_insns < block->num_insns)
+            || (stop_pc > block->pc
+                && stop_pc < block->pc + 4 * block->num_insns))
+        {
+            status = APEX_functional_step(cpu);
+            if (status != RUN_RETIRED)
+            {
+                return status;
+            }
+
+            if (max_insns > 0)
+            {
+                max_insns--;
+            }
+
+            /* The rest of the block is stepped as well, rather than
+             * translated again from every instruction */
+            if (block
+                && (cpu->pc <= block->pc
+                    || cpu->pc >= block->pc + 4 * block->num_insns))
+            {
+                block = NULL;
+            }
+            continue;
+        }
+
+        completed = cpu->insn_completed;
+        block = run_block(cpu, block, &status);
+        if (max_insns > 0)
+        {
+            max_insns -= cpu->insn_completed - completed;
+        }
+
+        if (status == BLOCK_HALTED)
+        {
+            return RUN_HALTED;
+        }
+
+        if (status == BLOCK_SIDE_EXIT && max_insns != 0)
+        {
+            /* Access off the cached page, stepped exactly as without the
+             * JIT. The step caches the page if it is mapped in */
+            status = APEX_functional_step(cpu);
+            if (status != RUN_RETIRED)
+            {
+                return status;
+            }
+
+            if (max_insns > 0)
+            {
+                max_insns--;
+            }
+        }
+    }
+
+    return RUN_RETIRED;
+}
@@ -0,0 +1,486 @@
+/*
+ * apex_incremental.c
+ * Contains incremental runs: a run that keeps a snapshot every so many
+ * cycles in a directory, with a record of the program it ran and the cycle
+ * each code memory slot was first fetched at. The next run of an edited
+ * program in the same directory starts from the last snapshot taken before
+ * any edited slot was fetched, since up to there it runs as the last one
+ * did.
+ *
+ * A snapshot only holds for a run starting from the same state with the
+ * same options, which the record keeps the key of. Snapshots taken by the
+ * last run past the one started from are replaced or removed, so the
+ * directory holds those of the last run only. Each snapshot holds all of
+ * data memory, so no more than INCREMENTAL_MAX_CHECKPOINTS are kept: once
+ * there are that many, they are taken twice as far apart and every other
+ * one is removed
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Start of the record of a run, followed by num_checkpoints
+ * APEX_Incremental_Checkpoint by increasing cycle, the code_slots
+ * instructions it ran and the cycle each of them was first fetched at, -1
+ * if never */
+typedef struct APEX_Incremental_Header
+{
+    char magic[8];                 /* APEX_INCREMENTAL_MAGIC */
+    unsigned int version;          /* APEX_INCREMENTAL_VERSION */
+    unsigned int forwarding;       /* APEX_FORWARDING of the writer */
+    unsigned long long state_key[2]; /* Of the state and options, no code */
+    unsigned int code_slots;
+    unsigned int num_checkpoints;
+    int every;                     /* Cycles between snapshots at the end */
+} APEX_Incremental_Header;
+
+/* Snapshot kept in the directory, named after its cycle */
+typedef struct APEX_Incremental_Checkpoint
+{
+    int cycle;
+    unsigned long long code_hash;  /* Of the program it was taken running */
+} APEX_Incremental_Checkpoint;
+
+/* Record of the run going on */
+struct APEX_Incremental
+{
+    unsigned long long state_key[2];
+    unsigned long long code_hash;
+    int every;                     /* Cycles between snapshots */
+    APEX_Incremental_Checkpoint *checkpoints;
+    int num_checkpoints;
+    int max_checkpoints;
+    int *stale;                    /* Cycles of snapshots of the last run */
+    int num_stale;                 /* not started from */
+};
+
+/*
+ * Puts the name of file name in the directory of cpu into path.
+ *
+ * Returns FALSE if it does not fit
+ */
+static int
+dir_path(const APEX_CPU *cpu, const char *name, char *path, size_t size)
+{
+    return snprintf(path, size, "%s/%s", cpu->incremental_dir, name)
+           < (int)size;
+}
+
+/*
+ * Puts the file name of the snapshot taken at cycle into path.
+ *
+ * Returns FALSE if it does not fit
+ */
+static int
+checkpoint_path(const APEX_CPU *cpu, int cycle, char *path, size_t size)
+{
+    return snprintf(path, size, "%s/%d.snap", cpu->incremental_dir, cycle)
+           < (int)size;
+}
+
+/*
+ * Adds the snapshot taken at cycle to the record.
+ *
+ * Returns FALSE if there is no memory for it
+ */
+static int
+add_checkpoint(struct APEX_Incremental *inc, int cycle,
+               unsigned long long code_hash)
+{
+    APEX_Incremental_Checkpoint *checkpoints;
+    int max;
+
+    if (inc->num_checkpoints == inc->max_checkpoints)
+    {
+        max = inc->max_checkpoints ? 2 * inc->max_checkpoints : 64;
+        checkpoints = realloc(inc->checkpoints, max * sizeof(*checkpoints));
+        if (!checkpoints)
+        {
+            return FALSE;
+        }
+        inc->checkpoints = checkpoints;
+        inc->max_checkpoints = max;
+    }
+
+    /* Zeroed, so that struct padding is written as zeros */
+    checkpoints = &inc->checkpoints[inc->num_checkpoints++];
+    memset(checkpoints, 0, sizeof(*checkpoints));
+    checkpoints->cycle = cycle;
+    checkpoints->code_hash = code_hash;
+    return TRUE;
+}
+
+/*
+ * Returns the first cycle the last run fetched a slot at that the program
+ * of cpu holds another instruction in, INT_MAX if there is none
+ */
+static int
+first_edit_fetched(const APEX_CPU *cpu, const APEX_Incremental_Header *header,
+                   const APEX_Instruction *code, const int *first_fetch)
+{
+    int limit = INT_MAX;
+    unsigned int s;
+
+    for (s = 0; s < header->code_slots; s++)
+    {
+        if (first_fetch[s] < 0 || first_fetch[s] >= limit)
+        {
+            continue;
+        }
+        /* Slots the program no longer has count as edited */
+        if (s >= (unsigned int)cpu->code_memory_slots
+            || memcmp(&code[s], &cpu->code_memory[s], sizeof(*code)) != 0)
+        {
+            limit = first_fetch[s];
+        }
+    }
+    return limit;
+}
+
+/*
+ * Starts cpu from the last snapshot of the run recorded in the directory
+ * that was taken before it fetched anything the program of cpu changed,
+ * carrying over what the record holds up to there
+ */
+static void
+resume_last_run(APEX_CPU *cpu, struct APEX_Incremental *inc)
+{
+    const APEX_Incremental_Header *header;
+    const APEX_Incremental_Checkpoint *checkpoints;
+    const APEX_Instruction *code;
+    const int *first_fetch;
+    char path[4096];
+    struct stat st;
+    void *data;
+    int resumed = -1;
+    int limit;
+    int valid;
+    int fd;
+    int i;
+
+    if (!dir_path(cpu, "run", path, sizeof(path)))
+    {
+        return;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header))
+    {
+        fprintf(stderr, "APEX_Error: Ignoring bad incremental record %s\n",
+                path);
+        close(fd);
+        return;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return;
+    }
+
+    header = data;
+    checkpoints = (const APEX_Incremental_Checkpoint *)(header + 1);
+    code = (const APEX_Instruction *)(checkpoints + header->num_checkpoints);
+    first_fetch = (const int *)(code + header->code_slots);
+    valid = memcmp(header->magic, APEX_INCREMENTAL_MAGIC,
+                   sizeof(APEX_INCREMENTAL_MAGIC))
+                == 0
+            && header->version == APEX_INCREMENTAL_VERSION
+            && header->forwarding == APEX_FORWARDING
+            && header->code_slots <= (unsigned int)INT_MAX / sizeof(*code)
+            && header->num_checkpoints
+                   <= (unsigned int)INT_MAX / sizeof(*checkpoints)
+            && (size_t)st.st_size
+                   == sizeof(*header)
+                          + header->code_slots
+                                * (sizeof(*code) + sizeof(*first_fetch))
+                          + header->num_checkpoints * sizeof(*checkpoints);
+    if (!valid)
+    {
+        fprintf(stderr, "APEX_Error: Ignoring bad incremental record %s\n",
+                path);
+        munmap(data, st.st_size);
+        return;
+    }
+
+    /* The snapshot at a cycle is taken before that cycle fetches. A run
+     * from another state or with other options is started over */
+    limit = first_edit_fetched(cpu, header, code, first_fetch);
+    if (header->state_key[0] != inc->state_key[0]
+        || header->state_key[1] != inc->state_key[1])
+    {
+        limit = -1;
+    }
+    for (i = header->num_checkpoints - 1; i >= 0 && resumed < 0; i--)
+    {
+        if (checkpoints[i].cycle <= limit
+            && checkpoint_path(cpu, checkpoints[i].cycle, path, sizeof(path))
+            && APEX_snapshot_resume(cpu, path, checkpoints[i].code_hash))
+        {
+            resumed = checkpoints[i].cycle;
+        }
+    }
+
+    if (header->num_checkpoints > 0)
+    {
+        inc->stale = malloc(header->num_checkpoints * sizeof(int));
+    }
+    for (i = 0; i < (int)header->num_checkpoints; i++)
+    {
+        if (resumed >= 0 && checkpoints[i].cycle <= resumed)
+        {
+            add_checkpoint(inc, checkpoints[i].cycle, checkpoints[i].code_hash);
+        }
+        else if (inc->stale)
+        {
+            inc->stale[inc->num_stale++] = checkpoints[i].cycle;
+        }
+    }
+
+    if (resumed >= 0)
+    {
+        /* Going on as far apart as the last run ended up */
+        if (header->every > inc->every && header->every % inc->every == 0)
+        {
+            inc->every = header->every;
+        }
+        for (i = 0; i < (int)header->code_slots && i < cpu->code_memory_slots;
+             i++)
+        {
+            if (first_fetch[i] < resumed)
+            {
+                cpu->first_fetch[i] = first_fetch[i];
+            }
+        }
+        fprintf(stderr, "APEX_CPU: Resuming from cycle %d of the last run\n",
+                resumed);
+    }
+    munmap(data, st.st_size);
+}
+
+/*
+ * Frees the record of the run of cpu
+ */
+static void
+free_incremental(APEX_CPU *cpu)
+{
+    if (cpu->incremental)
+    {
+        free(cpu->incremental->checkpoints);
+        free(cpu->incremental->stale);
+        free(cpu->incremental);
+    }
+    free(cpu->first_fetch);
+    cpu->incremental = NULL;
+    cpu->first_fetch = NULL;
+}
+
+/*
+ * Starts recording the run cpu is about to start in its directory, going
+ * on from where the last run recorded there can be resumed.
+ *
+ * Returns FALSE if the run is not recorded
+ */
+int
+APEX_incremental_start(APEX_CPU *cpu)
+{
+    int i;
+
+    if (!cpu->incremental_dir)
+    {
+        return FALSE;
+    }
+    if (cpu->clock != 0 || cpu->insn_completed != 0)
+    {
+        fprintf(stderr, "APEX_Error: The incremental mode runs a program from "
+                "its start\n");
+        return FALSE;
+    }
+    if (mkdir(cpu->incremental_dir, 0777) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "APEX_Error: Unable to create %s\n",
+                cpu->incremental_dir);
+        return FALSE;
+    }
+
+    cpu->incremental = calloc(1, sizeof(*cpu->incremental));
+    cpu->first_fetch = malloc(cpu->code_memory_slots * sizeof(int));
+    if (!cpu->incremental || !cpu->first_fetch)
+    {
+        free_incremental(cpu);
+        return FALSE;
+    }
+    for (i = 0; i < cpu->code_memory_slots; i++)
+    {
+        cpu->first_fetch[i] = -1;
+    }
+
+    APEX_cache_key(cpu, FALSE, cpu->incremental->state_key);
+    cpu->incremental->code_hash = APEX_snapshot_code_hash(cpu);
+    cpu->incremental->every = cpu->incremental_every;
+    resume_last_run(cpu, cpu->incremental);
+    return TRUE;
+}
+
+/*
+ * Doubles the cycles between snapshots, removing those that no longer fall
+ * on a multiple of them
+ */
+static void
+thin_checkpoints(APEX_CPU *cpu, struct APEX_Incremental *inc)
+{
+    char path[4096];
+    int kept = 0;
+    int i;
+
+    inc->every *= 2;
+    for (i = 0; i < inc->num_checkpoints; i++)
+    {
+        if (inc->checkpoints[i].cycle % inc->every == 0)
+        {
+            inc->checkpoints[kept++] = inc->checkpoints[i];
+        }
+        else if (checkpoint_path(cpu, inc->checkpoints[i].cycle, path,
+                                 sizeof(path)))
+        {
+            unlink(path);
+        }
+    }
+    inc->num_checkpoints = kept;
+}
+
+/*
+ * Takes the snapshot of the cycle cpu is at if one is due, unless the run
+ * started from it. Failing to is reported, the run is not affected
+ */
+void
+APEX_incremental_checkpoint(APEX_CPU *cpu)
+{
+    struct APEX_Incremental *inc = cpu->incremental;
+    char path[4096];
+
+    if (cpu->clock % inc->every != 0
+        || (inc->num_checkpoints > 0
+            && inc->checkpoints[inc->num_checkpoints - 1].cycle
+                   >= cpu->clock))
+    {
+        return;
+    }
+    if (inc->num_checkpoints >= INCREMENTAL_MAX_CHECKPOINTS)
+    {
+        thin_checkpoints(cpu, inc);
+        if (cpu->clock % inc->every != 0)
+        {
+            return;
+        }
+    }
+    if (!checkpoint_path(cpu, cpu->clock, path, sizeof(path)))
+    {
+        fprintf(stderr, "APEX_Error: Incremental directory name too long\n");
+        return;
+    }
+    if (APEX_snapshot_save(cpu, path))
+    {
+        add_checkpoint(inc, cpu->clock, inc->code_hash);
+    }
+}
+
+/*
+ * Writes the record of the run of cpu, once it is over, for the next run
+ * to resume from, and removes the snapshots of the last run it did not
+ * take again
+ */
+void
+APEX_incremental_finish(APEX_CPU *cpu)
+{
+    struct APEX_Incremental *inc = cpu->incremental;
+    APEX_Incremental_Header header;
+    char path[4096];
+    char temp[4096];
+    FILE *fp;
+    int written;
+    int i;
+    int j;
+
+    if (!inc)
+    {
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, APEX_INCREMENTAL_MAGIC,
+           sizeof(APEX_INCREMENTAL_MAGIC));
+    header.version = APEX_INCREMENTAL_VERSION;
+    header.forwarding = APEX_FORWARDING;
+    header.state_key[0] = inc->state_key[0];
+    header.state_key[1] = inc->state_key[1];
+    header.code_slots = cpu->code_memory_slots;
+    header.num_checkpoints = inc->num_checkpoints;
+    header.every = inc->every;
+
+    if (!dir_path(cpu, "run", path, sizeof(path))
+        || !dir_path(cpu, "run.tmp", temp, sizeof(temp)))
+    {
+        fprintf(stderr, "APEX_Error: Incremental directory name too long\n");
+        free_incremental(cpu);
+        return;
+    }
+
+    fp = fopen(temp, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", temp);
+        free_incremental(cpu);
+        return;
+    }
+    written = fwrite(&header, sizeof(header), 1, fp) == 1
+              && fwrite(inc->checkpoints, sizeof(*inc->checkpoints),
+                        inc->num_checkpoints, fp)
+                     == (size_t)inc->num_checkpoints
+              && fwrite(cpu->code_memory, sizeof(APEX_Instruction),
+                        cpu->code_memory_slots, fp)
+                     == (size_t)cpu->code_memory_slots
+              && fwrite(cpu->first_fetch, sizeof(int), cpu->code_memory_slots,
+                        fp)
+                     == (size_t)cpu->code_memory_slots;
+    if (fclose(fp) != 0 || !written || rename(temp, path) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", path);
+        unlink(temp);
+        free_incremental(cpu);
+        return;
+    }
+
+    /* Both lists are by increasing cycle */
+    for (i = 0, j = 0; i < inc->num_stale; i++)
+    {
+        while (j < inc->num_checkpoints
+               && inc->checkpoints[j].cycle < inc->stale[i])
+        {
+            j++;
+        }
+        if ((j == inc->num_checkpoints
+             || inc->checkpoints[j].cycle != inc->stale[i])
+            && checkpoint_path(cpu, inc->stale[i], path, sizeof(path)))
+        {
+            unlink(path);
+        }
+    }
+    free_incremental(cpu);
+}
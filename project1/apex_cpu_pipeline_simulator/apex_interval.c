@@ -0,0 +1,329 @@
+/*
+ * apex_interval.c
+ * Contains the interval mode: the functional simulator checkpoints the
+ * program every interval_insns instructions, then threads simulate the
+ * intervals in the pipeline in parallel and their cycles are added up
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Detailed simulation of one interval */
+typedef struct APEX_Interval
+{
+    int status;                    /* RUN_* */
+    int insns;                     /* Instructions measured */
+    int cycles;
+    int decode_stall_cycles;
+    int fetch_stall_cycles;
+} APEX_Interval;
+
+/* Intervals shared by the worker threads */
+typedef struct APEX_Interval_Job
+{
+    const APEX_CPU *base;          /* Code memory and options */
+    const APEX_Checkpoint *checkpoints; /* Warm-up start of every interval */
+    APEX_Interval *intervals;
+    int num_intervals;
+    atomic_int next;               /* Next interval nobody has taken */
+} APEX_Interval_Job;
+
+/*
+ * Simulates interval i on cpu: warms the pipeline up from the checkpoint
+ * of the interval, then measures interval_insns instructions
+ */
+static void
+simulate_interval(const APEX_Interval_Job *job, APEX_CPU *cpu, int i)
+{
+    const APEX_Checkpoint *checkpoint = &job->checkpoints[i];
+    APEX_Interval *interval = &job->intervals[i];
+    int start_clock;
+    int start_insns;
+    int start_decode_stalls;
+    int start_fetch_stalls;
+
+    APEX_cpu_start_at(cpu, checkpoint);
+
+    /* The checkpoint is interval_warmup instructions before the interval,
+     * except for the first one */
+    interval->status = APEX_cpu_run_insns(
+        cpu, i * job->base->interval_insns - checkpoint->insn_completed);
+    if (interval->status != RUN_RETIRED)
+    {
+        /* The previous interval ran into the end of the program */
+        interval->status = RUN_RETIRED;
+        return;
+    }
+
+    start_clock = cpu->clock;
+    start_insns = cpu->insn_completed;
+    start_decode_stalls = cpu->decode_stall_cycles;
+    start_fetch_stalls = cpu->fetch_stall_cycles;
+
+    interval->status = APEX_cpu_run_insns(cpu, job->base->interval_insns);
+    interval->insns = cpu->insn_completed - start_insns;
+    interval->cycles = cpu->clock - start_clock;
+    interval->decode_stall_cycles
+        = cpu->decode_stall_cycles - start_decode_stalls;
+    interval->fetch_stall_cycles = cpu->fetch_stall_cycles - start_fetch_stalls;
+}
+
+/*
+ * Worker thread: takes intervals until none is left, on a CPU of its own
+ */
+static void *
+interval_worker(void *arg)
+{
+    APEX_Interval_Job *job = arg;
+    APEX_CPU *cpu;
+    int i;
+
+    cpu = malloc(sizeof(APEX_CPU));
+    if (!cpu)
+    {
+        return NULL;
+    }
+
+    /* Shares code memory with the base CPU, nothing it owns is freed. Data
+     * memory is its own */
+    *cpu = *job->base;
+    cpu->block_cache = NULL;
+    cpu->block_cache_code = NULL;
+    cpu->jit_code = NULL;
+    cpu->stream = NULL;
+    cpu->arena = NULL;
+    APEX_memory_init(&cpu->data_memory, job->base->data_memory.huge_pages);
+
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->num_intervals)
+    {
+        simulate_interval(job, cpu, i);
+    }
+
+    APEX_memory_free(&cpu->data_memory);
+    free(cpu);
+    return NULL;
+}
+
+/*
+ * Frees num_checkpoints checkpoints and their array
+ */
+static void
+free_checkpoints(APEX_Checkpoint *checkpoints, int num_checkpoints)
+{
+    int i;
+
+    for (i = 0; i < num_checkpoints; i++)
+    {
+        APEX_checkpoint_free(&checkpoints[i]);
+    }
+    free(checkpoints);
+}
+
+/*
+ * Runs the functional simulator over the whole program, saving the
+ * checkpoint every interval is simulated from. An interval the program
+ * ends before has none.
+ *
+ * Returns the checkpoints, NULL if out of memory or if the program left
+ * code memory
+ */
+static APEX_Checkpoint *
+take_checkpoints(APEX_CPU *cpu, int *num_checkpoints)
+{
+    APEX_Checkpoint *checkpoints = NULL;
+    APEX_Checkpoint *grown;
+    int capacity = 0;
+    int status;
+    int n = 0;
+
+    for (;;)
+    {
+        if (n == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 64;
+            grown = realloc(checkpoints, capacity * sizeof(APEX_Checkpoint));
+            if (!grown)
+            {
+                fprintf(stderr, "APEX_Error: Out of memory for %d intervals\n", capacity);
+                free_checkpoints(checkpoints, n);
+                return NULL;
+            }
+            checkpoints = grown;
+        }
+
+        APEX_checkpoint_save(cpu, &checkpoints[n]);
+
+        /* Start of the interval, which has nothing to measure if the
+         * program ends in its warm-up */
+        status = APEX_functional_run(
+            cpu, n * cpu->interval_insns - cpu->insn_completed, -1);
+        if (status != RUN_RETIRED)
+        {
+            APEX_checkpoint_free(&checkpoints[n]);
+            break;
+        }
+        n++;
+
+        /* Warm-up start of the next interval */
+        status = APEX_functional_run(
+            cpu,
+            n * cpu->interval_insns - cpu->interval_warmup
+                - cpu->insn_completed,
+            -1);
+        if (status != RUN_RETIRED)
+        {
+            break;
+        }
+    }
+
+    if (status == RUN_LEFT_CODE)
+    {
+        fprintf(stderr, "APEX_Error: The program left code memory at PC %d\n", cpu->pc);
+        free_checkpoints(checkpoints, n);
+        return NULL;
+    }
+
+    *num_checkpoints = n;
+    return checkpoints;
+}
+
+/*
+ * Interval mode, see the top of this file. cpu is left in the final state
+ * of the functional simulator
+ */
+void
+APEX_interval_run(APEX_CPU *cpu)
+{
+    APEX_Interval_Job job;
+    APEX_Checkpoint *checkpoints;
+    APEX_Interval *intervals;
+    pthread_t *threads;
+    APEX_CPU *serial;
+    int num_checkpoints = 0;
+    int num_threads;
+    int started;
+    int stitched = 0;
+    int status = RUN_RETIRED;
+    int cycles = 0;
+    int insns = 0;
+    int decode_stalls = 0;
+    int fetch_stalls = 0;
+    int i;
+
+    if (cpu->interval_warmup < 0 || cpu->interval_warmup >= cpu->interval_insns)
+    {
+        fprintf(stderr, "APEX_Error: The interval warm-up must be shorter than the interval\n");
+        return;
+    }
+
+    /* The base CPU keeps its initial state for the workers to copy, data
+     * memory is taken from the checkpoints */
+    serial = malloc(sizeof(APEX_CPU));
+    if (!serial)
+    {
+        return;
+    }
+    *serial = *cpu;
+    APEX_memory_init(&serial->data_memory, cpu->data_memory.huge_pages);
+
+    checkpoints = take_checkpoints(cpu, &num_checkpoints);
+    if (!checkpoints)
+    {
+        APEX_memory_free(&serial->data_memory);
+        free(serial);
+        return;
+    }
+    intervals = calloc(num_checkpoints, sizeof(APEX_Interval));
+    num_threads = cpu->interval_threads > 0 ? cpu->interval_threads
+                                            : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+    threads = calloc(num_threads, sizeof(pthread_t));
+    if (!intervals || !threads)
+    {
+        fprintf(stderr, "APEX_Error: Out of memory for %d intervals\n", num_checkpoints);
+        free_checkpoints(checkpoints, num_checkpoints);
+        free(intervals);
+        free(threads);
+        free(serial);
+        return;
+    }
+
+    job.base = serial;
+    job.checkpoints = checkpoints;
+    job.intervals = intervals;
+    job.num_intervals = num_checkpoints;
+    atomic_init(&job.next, 0);
+
+    for (started = 0; started < num_threads; started++)
+    {
+        if (pthread_create(&threads[started], NULL, interval_worker, &job) != 0)
+        {
+            break;
+        }
+    }
+    if (started == 0)
+    {
+        /* Without threads the intervals are simulated here */
+        interval_worker(&job);
+    }
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* Stitch the intervals together, up to the first that ended the run */
+    for (i = 0; i < num_checkpoints; i++, stitched++)
+    {
+        printf("APEX_INTERVAL: Interval %d, cycles = %d instructions = %d decode stalls = %d fetch stalls = %d\n",
+               i, intervals[i].cycles, intervals[i].insns,
+               intervals[i].decode_stall_cycles,
+               intervals[i].fetch_stall_cycles);
+        cycles += intervals[i].cycles;
+        insns += intervals[i].insns;
+        decode_stalls += intervals[i].decode_stall_cycles;
+        fetch_stalls += intervals[i].fetch_stall_cycles;
+        status = intervals[i].status;
+        if (status != RUN_RETIRED)
+        {
+            stitched++;
+            break;
+        }
+    }
+
+    cpu->run_status = (status == RUN_DEADLOCKED) ? RUN_DEADLOCKED : RUN_HALTED;
+    printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+           status == RUN_DEADLOCKED ? "Deadlocked" : "Complete", cycles,
+           insns);
+    printf("APEX_INTERVAL: Intervals = %d threads = %d decode stalls = %d fetch stalls = %d\n",
+           stitched, started ? started : 1, decode_stalls,
+           fetch_stalls);
+
+    if (cpu->interval_verify)
+    {
+        /* The whole program in one piece, as without intervals */
+        APEX_cpu_start_at(serial, &checkpoints[0]);
+        APEX_cpu_run_insns(serial, -1);
+        printf("APEX_INTERVAL: Serial cycles = %d, error = %+d (%+.3f%%)\n",
+               serial->clock, cycles - serial->clock,
+               serial->clock ? 100.0 * (cycles - serial->clock) / serial->clock
+                             : 0.0);
+    }
+
+    free(threads);
+    free(intervals);
+    free_checkpoints(checkpoints, num_checkpoints);
+    APEX_memory_free(&serial->data_memory);
+    free(serial);
+}
@@ -0,0 +1,309 @@
+/*
+ * apex_jit.c
+ * Contains the x86-64 code generator of the functional simulator, which
+ * compiles the body of a translated block into native code
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <sys/mman.h>
+
+/* Largest native code of one APEX instruction, in bytes */
+#define JIT_MAX_INSN_BYTES 64
+
+/* Offsets in APEX_CPU of the state used by native code, which gets the CPU
+ * pointer in rdi and keeps it there */
+#define REG_OFFSET(r) ((int)(offsetof(APEX_CPU, regs) + 4 * (r)))
+#define ZERO_FLAG_OFFSET ((int)offsetof(APEX_CPU, zero_flag))
+#define LAST_PAGE_OFFSET ((int)offsetof(APEX_CPU, data_memory.last_page))
+#define LAST_WORDS_OFFSET ((int)offsetof(APEX_CPU, data_memory.last_words))
+#define STORE_PAGE_OFFSET ((int)offsetof(APEX_CPU, data_memory.store_page))
+#define STORE_WORDS_OFFSET ((int)offsetof(APEX_CPU, data_memory.store_words))
+
+static unsigned char *
+emit_byte(unsigned char *p, int byte)
+{
+    *p++ = (unsigned char)byte;
+    return p;
+}
+
+static unsigned char *
+emit_int(unsigned char *p, int value)
+{
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
+}
+
+/* op eax, [rdi + disp32], or op ecx with modrm 0x8f and edx with 0x97 */
+static unsigned char *
+emit_reg_mem(unsigned char *p, int opcode, int modrm, int disp)
+{
+    p = emit_byte(p, opcode);
+    p = emit_byte(p, modrm);
+    return emit_int(p, disp);
+}
+
+/* mov eax, [rdi + regs[r]] */
+static unsigned char *
+emit_load_eax(unsigned char *p, int r)
+{
+    return emit_reg_mem(p, 0x8b, 0x87, REG_OFFSET(r));
+}
+
+/* mov [rdi + regs[r]], eax */
+static unsigned char *
+emit_store_eax(unsigned char *p, int r)
+{
+    return emit_reg_mem(p, 0x89, 0x87, REG_OFFSET(r));
+}
+
+/* zero_flag = (eax == 0), clobbers eax */
+static unsigned char *
+emit_set_zero_flag(unsigned char *p)
+{
+    p = emit_byte(p, 0x85); /* test eax, eax */
+    p = emit_byte(p, 0xc0);
+    p = emit_byte(p, 0x0f); /* sete al */
+    p = emit_byte(p, 0x94);
+    p = emit_byte(p, 0xc0);
+    p = emit_byte(p, 0x0f); /* movzx eax, al */
+    p = emit_byte(p, 0xb6);
+    p = emit_byte(p, 0xc0);
+    return emit_reg_mem(p, 0x89, 0x87, ZERO_FLAG_OFFSET);
+}
+
+/* Returns index from native code: mov eax, index; ret */
+static unsigned char *
+emit_return(unsigned char *p, int index)
+{
+    p = emit_byte(p, 0xb8);
+    p = emit_int(p, index);
+    return emit_byte(p, 0xc3);
+}
+
+/*
+ * Points rdx at the page of a LOAD, STORE, LDR or STR and puts the word
+ * index in the page in ecx. Native code only knows the pages cached by
+ * APEX_memory_load and APEX_memory_store, the block is left at instruction
+ * index for any other
+ */
+static unsigned char *
+emit_address(unsigned char *p, const APEX_Instruction *insn, int index)
+{
+    int store = insn->opcode == OPCODE_STORE || insn->opcode == OPCODE_STR;
+
+    p = emit_reg_mem(p, 0x8b, 0x8f, REG_OFFSET(insn->rs1)); /* mov ecx */
+
+    if (insn->opcode == OPCODE_LDR || insn->opcode == OPCODE_STR)
+    {
+        p = emit_reg_mem(p, 0x03, 0x8f, REG_OFFSET(insn->rs2)); /* add ecx */
+    }
+    else
+    {
+        p = emit_byte(p, 0x81); /* add ecx, imm32 */
+        p = emit_byte(p, 0xc1);
+        p = emit_int(p, insn->imm);
+    }
+
+    p = emit_byte(p, 0x89); /* mov edx, ecx */
+    p = emit_byte(p, 0xca);
+    p = emit_byte(p, 0xc1); /* shr edx, DATA_PAGE_SHIFT */
+    p = emit_byte(p, 0xea);
+    p = emit_byte(p, DATA_PAGE_SHIFT);
+    p = emit_reg_mem(p, 0x3b, 0x97,
+                     store ? STORE_PAGE_OFFSET : LAST_PAGE_OFFSET); /* cmp edx */
+    p = emit_byte(p, 0x74); /* je over the side exit */
+    p = emit_byte(p, 0x06);
+    p = emit_return(p, index);
+
+    p = emit_byte(p, 0x81); /* and ecx, DATA_PAGE_MASK */
+    p = emit_byte(p, 0xe1);
+    p = emit_int(p, DATA_PAGE_MASK);
+    p = emit_byte(p, 0x48); /* mov rdx, [rdi + page words] */
+    return emit_reg_mem(p, 0x8b, 0x97,
+                        store ? STORE_WORDS_OFFSET : LAST_WORDS_OFFSET);
+}
+
+/*
+ * Emits the native code of one instruction, the instruction index-th of its
+ * block
+ */
+static unsigned char *
+emit_insn(unsigned char *p, const APEX_Instruction *insn, int index)
+{
+    switch (insn->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        {
+            static const unsigned char alu_opcodes[NUM_OPCODES] = {
+                [OPCODE_ADD] = 0x03, [OPCODE_SUB] = 0x2b, [OPCODE_AND] = 0x23,
+                [OPCODE_OR] = 0x0b, [OPCODE_XOR] = 0x33,
+            };
+
+            p = emit_load_eax(p, insn->rs1);
+            p = emit_reg_mem(p, alu_opcodes[insn->opcode], 0x87,
+                             REG_OFFSET(insn->rs2));
+            p = emit_store_eax(p, insn->rd);
+            return emit_set_zero_flag(p);
+        }
+
+        case OPCODE_MUL:
+        {
+            p = emit_load_eax(p, insn->rs1);
+            p = emit_byte(p, 0x0f); /* imul eax, [rdi + disp32] */
+            p = emit_reg_mem(p, 0xaf, 0x87, REG_OFFSET(insn->rs2));
+            p = emit_store_eax(p, insn->rd);
+            return emit_set_zero_flag(p);
+        }
+
+        case OPCODE_DIV:
+        {
+            p = emit_load_eax(p, insn->rs1);
+            p = emit_byte(p, 0x99); /* cdq */
+            p = emit_reg_mem(p, 0xf7, 0xbf, REG_OFFSET(insn->rs2)); /* idiv */
+            p = emit_store_eax(p, insn->rd);
+            return emit_set_zero_flag(p);
+        }
+
+        case OPCODE_MOVC:
+        {
+            p = emit_reg_mem(p, 0xc7, 0x87, REG_OFFSET(insn->rd)); /* mov */
+            p = emit_int(p, insn->imm);
+            p = emit_reg_mem(p, 0xc7, 0x87, ZERO_FLAG_OFFSET);
+            return emit_int(p, insn->imm == 0);
+        }
+
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        {
+            p = emit_load_eax(p, insn->rs1);
+            /* add eax, imm32 or sub eax, imm32 */
+            p = emit_byte(p, insn->opcode == OPCODE_ADDL ? 0x05 : 0x2d);
+            p = emit_int(p, insn->imm);
+            return emit_store_eax(p, insn->rd);
+        }
+
+        case OPCODE_LOAD:
+        case OPCODE_LDR:
+        {
+            p = emit_address(p, insn, index);
+            p = emit_byte(p, 0x8b); /* mov eax, [rdx + rcx * 4] */
+            p = emit_byte(p, 0x04);
+            p = emit_byte(p, 0x8a);
+            return emit_store_eax(p, insn->rd);
+        }
+
+        case OPCODE_STORE:
+        case OPCODE_STR:
+        {
+            p = emit_address(p, insn, index);
+            p = emit_load_eax(p, insn->rd);
+            p = emit_byte(p, 0x89); /* mov [rdx + rcx * 4], eax */
+            p = emit_byte(p, 0x04);
+            return emit_byte(p, 0x8a);
+        }
+    }
+
+    return p;
+}
+
+/*
+ * Compiles count instructions starting at code memory index start, none of
+ * which may be a branch or HALT.
+ *
+ * The native code returns count when it runs to the end, or the index of a
+ * LOAD, STORE, LDR or STR off the cached pages, which it leaves to the
+ * interpreter without executing it.
+ *
+ * Returns NULL if the code buffer is full
+ */
+APEX_Native_Block
+APEX_jit_compile(APEX_CPU *cpu, int start, int count)
+{
+    unsigned char *code;
+    unsigned char *p;
+    int size = (count + 1) * JIT_MAX_INSN_BYTES;
+    int i;
+
+    if (!cpu->jit_code)
+    {
+        cpu->jit_code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (cpu->jit_code == MAP_FAILED)
+        {
+            cpu->jit_code = NULL;
+            return NULL;
+        }
+        cpu->jit_code_used = 0;
+    }
+    else if (mprotect(cpu->jit_code, JIT_CODE_SIZE, PROT_READ | PROT_WRITE))
+    {
+        return NULL;
+    }
+
+    code = NULL;
+    if (cpu->jit_code_used + size <= JIT_CODE_SIZE)
+    {
+        code = cpu->jit_code + cpu->jit_code_used;
+        p = code;
+        for (i = 0; i < count; ++i)
+        {
+            p = emit_insn(p, &cpu->code_memory[start + i], i);
+        }
+        p = emit_return(p, count);
+        cpu->jit_code_used += p - code;
+    }
+
+    /* Code is never writable and executable at the same time */
+    if (mprotect(cpu->jit_code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC))
+    {
+        return NULL;
+    }
+
+    return (APEX_Native_Block)code;
+}
+
+/*
+ * Releases the native code of all blocks
+ */
+void
+APEX_jit_free(APEX_CPU *cpu)
+{
+    if (cpu->jit_code)
+    {
+        munmap(cpu->jit_code, JIT_CODE_SIZE);
+    }
+    cpu->jit_code = NULL;
+    cpu->jit_code_used = 0;
+}
+
+#else
+
+/* Other hosts run every block in the interpreter */
+APEX_Native_Block
+APEX_jit_compile(APEX_CPU *cpu, int start, int count)
+{
+    return NULL;
+}
+
+void
+APEX_jit_free(APEX_CPU *cpu)
+{
+}
+
+#endif
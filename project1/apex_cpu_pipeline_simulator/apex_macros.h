@@ -0,0 +1,202 @@
+/*
+ * apex_macros.h
+ * Contains APEX cpu pipeline macros
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _MACROS_H_
+#define _MACROS_H_
+
+#define FALSE 0x0
+#define TRUE 0x1
+
+/* Pipeline variant, chosen at compile time, see the Makefile
+ *
+ * APEX_FORWARDING 0: decode interlocks on registers waiting for writeback
+ * APEX_FORWARDING 1: results are forwarded to decode from execute and memory
+ * APEX_TRACE 0: debug messages and the display mode are compiled out */
+#ifndef APEX_FORWARDING
+#define APEX_FORWARDING 0
+#endif
+
+#ifndef APEX_TRACE
+#define APEX_TRACE 1
+#endif
+
+/* Words of data memory the final state shows, the forwarding pipeline has
+ * always had one word less. Programs may use every 32-bit address */
+#if APEX_FORWARDING
+#define DATA_MEMORY_SIZE 99
+#else
+#define DATA_MEMORY_SIZE 100
+#endif
+
+/* Size of integer register file */
+#define REG_FILE_SIZE 16
+
+/* Zeroed code memory slots kept after the last instruction, fetch runs up to
+ * three slots past HALT before HALT retires */
+#define CODE_MEMORY_PADDING 4
+
+/* Code memory starts on a cache line, one line holds eight instructions */
+#define CODE_MEMORY_ALIGN 64
+
+/* Numeric OPCODE identifiers for instructions */
+#define OPCODE_ADD 0x0
+#define OPCODE_SUB 0x1
+#define OPCODE_MUL 0x2
+#define OPCODE_DIV 0x3
+#define OPCODE_AND 0x4
+#define OPCODE_OR 0x5
+#define OPCODE_XOR 0x6
+#define OPCODE_MOVC 0x7
+#define OPCODE_LOAD 0x8
+#define OPCODE_STORE 0x9
+#define OPCODE_BZ 0xa
+#define OPCODE_BNZ 0xb
+#define OPCODE_HALT 0xc
+#define OPCODE_STR 0xd
+#define OPCODE_LDR 0xe
+#define OPCODE_ADDL 0xf
+#define OPCODE_SUBL 0x10
+#define OPCODE_CMP 0x11
+
+/* Number of numeric opcodes */
+#define NUM_OPCODES 0x12
+
+/* Functional unit class of an instruction */
+#define FU_NONE 0x0
+#define FU_INT 0x1
+#define FU_MUL 0x2
+#define FU_MEM 0x3
+#define FU_BRANCH 0x4
+
+/* Static properties of an instruction */
+#define INSN_SETS_ZERO_FLAG 0x1
+#define INSN_READS_ZERO_FLAG 0x2
+#define INSN_BRANCH 0x4
+#define INSN_LOAD 0x8
+#define INSN_STORE 0x10
+#define INSN_HALT 0x20
+
+/* Debug messages of a CPU, see its debug_messages */
+#if APEX_TRACE
+#define ENABLE_DEBUG_MESSAGES(cpu) ((cpu)->debug_messages)
+#else
+/* Folds every debug message check away */
+#define ENABLE_DEBUG_MESSAGES(cpu) 0
+#endif
+
+/* Set this flag to 1 to enable cycle single-step mode */
+#define ENABLE_SINGLE_STEP 1
+
+/* Set this flag to 1 to stop stepping the clock once no latch can change */
+#define ENABLE_CYCLE_SKIPPING 1
+
+/* Outcome of a stretch of detailed simulation, see APEX_cpu_run_insns, or
+ * of functional simulation, which can also leave code memory, see
+ * APEX_functional_run */
+#define RUN_RETIRED 0x0
+#define RUN_HALTED 0x1
+#define RUN_DEADLOCKED 0x2
+#define RUN_LEFT_CODE 0x3
+
+/* Defaults of the interval mode: instructions per interval, simulated in
+ * detail by parallel threads, and detailed instructions run before each to
+ * fill the pipeline */
+#define INTERVAL_INSNS 1000000
+#define INTERVAL_WARMUP 100
+
+/* Defaults of the sampling mode, in instructions: one sample per period,
+ * each a detailed warm-up followed by a measured window */
+#define SAMPLE_PERIOD 100000
+#define SAMPLE_WARMUP 100
+#define SAMPLE_WINDOW 1000
+
+/* Instances run together by the batch engine, one per SIMD lane, eight
+ * 32-bit lanes fill an AVX2 register */
+#define APEX_BATCH_WIDTH 8
+
+/* Records in the ring between the functional thread and the timing model,
+ * a power of two */
+#define STREAM_RING_SIZE 4096
+
+/* Records the functional thread writes before publishing them */
+#define STREAM_PUBLISH_BATCH 64
+
+/* The text parser gives each thread at least this many bytes of the file,
+ * up to this many threads */
+#define PARSE_CHUNK_BYTES (1 << 20)
+#define PARSE_MAX_THREADS 64
+
+/* Start and version of binary program images, see APEX_Image_Header */
+#define APEX_IMAGE_MAGIC "APEXBIN"
+#define APEX_IMAGE_VERSION 1
+
+/* Start and version of final-state dumps, see APEX_Dump_Header */
+#define APEX_DUMP_MAGIC "APEXDMP"
+#define APEX_DUMP_VERSION 1
+
+/* Start and version of result cache entries, see apex_cache.c */
+#define APEX_CACHE_MAGIC "APEXRES"
+#define APEX_CACHE_VERSION 1
+
+/* Version of the snapshot file layout, see apex_snapshot.c */
+#define APEX_SNAPSHOT_VERSION 3
+
+/* Start and version of the record of an incremental run, the cycles
+ * between its snapshots unless set, and how many of them are kept, see
+ * apex_incremental.c */
+#define APEX_INCREMENTAL_MAGIC "APEXINC"
+#define APEX_INCREMENTAL_VERSION 1
+#define INCREMENTAL_EVERY 100000
+#define INCREMENTAL_MAX_CHECKPOINTS 32
+
+/* Address space reserved for the arena of a CPU, which holds the CPU and
+ * its program, in bytes. Pages are only backed once used, a program too
+ * big for the rest goes on the heap */
+#define ARENA_SIZE (64 << 20)
+
+/* Arenas are sized in huge pages, for the kernel to back them with */
+#define ARENA_HUGE_PAGE_SIZE (2 << 20)
+
+/* Set this flag to 1 to back arenas with transparent huge pages. Each CPU
+ * then faults in a whole zeroed huge page, which only pays off for large
+ * programs */
+#define ENABLE_ARENA_HUGE_PAGES 0
+
+/* Data memory is paged, see apex_memory.c. A page holds 1024 words, a page
+ * table 2048 pages and the directory 2048 tables, which covers every 32-bit
+ * word address */
+#define DATA_PAGE_SHIFT 10
+#define DATA_PAGE_WORDS (1 << DATA_PAGE_SHIFT)
+#define DATA_PAGE_MASK (DATA_PAGE_WORDS - 1)
+#define DATA_TABLE_SHIFT 11
+#define DATA_TABLE_SIZE (1 << DATA_TABLE_SHIFT)
+#define DATA_DIRECTORY_SIZE (1 << (32 - DATA_PAGE_SHIFT - DATA_TABLE_SHIFT))
+#define DATA_NUM_PAGES (1u << (32 - DATA_PAGE_SHIFT))
+
+/* Not the number of any page, the last-page cache starts out with it */
+#define DATA_NO_PAGE 0xffffffffu
+
+/* Pages are mapped in this many at a time, and the rest are kept for the
+ * pages touched next */
+#define DATA_CHUNK_PAGES 16
+
+/* Kinds of page given to APEX_memory_put_page */
+#define APEX_PAGE_CLEAN 0
+#define APEX_PAGE_DIRTY 1
+#define APEX_PAGE_ORIGINAL 2
+
+/* Set this flag to 1 to map data memory in huge pages, 512 pages at a
+ * time. Dense programs take fewer TLB misses, sparse ones waste memory. The
+ * huge_pages option sets it per CPU */
+#define ENABLE_DATA_HUGE_PAGES 0
+
+/* Size of the executable buffer holding the native code of translated
+ * blocks, in bytes */
+#define JIT_CODE_SIZE (1 << 20)
+
+#endif
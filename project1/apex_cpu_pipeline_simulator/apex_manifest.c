@@ -0,0 +1,457 @@
+/*
+ * apex_manifest.c
+ * Contains the manifest runner, which simulates a list of jobs in one
+ * process on a work-stealing thread pool. Every input file is parsed once
+ * and its code memory is shared, read-only, by the jobs running it
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* What a job runs */
+#define JOB_SIMULATE 0x0           /* The pipeline, limit in cycles */
+#define JOB_FUNCTIONAL 0x1         /* The functional simulator, limit in
+                                    * instructions */
+
+/* Longest input file name in a manifest */
+#define MANIFEST_MAX_PATH 4096
+
+/* Input file of one or more jobs, parsed once */
+typedef struct APEX_Program
+{
+    char *filename;
+    APEX_CPU *cpu;                 /* As loaded, NULL if it failed to load */
+    APEX_Checkpoint initial;       /* State the jobs start from */
+} APEX_Program;
+
+/* One line of the manifest, and its result */
+typedef struct APEX_Job
+{
+    int program;
+    int mode;                      /* JOB_* */
+    int limit;                     /* No limit if not positive */
+    int status;                    /* RUN_*, -1 if the job could not run */
+    int cycles;
+    int insns;
+} APEX_Job;
+
+/* Jobs of one worker. The owner takes from the bottom, thieves take from
+ * the top, so a long job only holds back the worker running it */
+typedef struct APEX_Job_Deque
+{
+    pthread_mutex_t lock;
+    int *jobs;                     /* Job indices */
+    int top;
+    int bottom;
+} APEX_Job_Deque;
+
+typedef struct APEX_Pool
+{
+    APEX_Job *jobs;
+    int num_jobs;
+    APEX_Program *programs;
+    int num_programs;
+    APEX_Job_Deque *deques;        /* One per worker */
+    int num_workers;
+    int num_started;               /* Worker threads running */
+    atomic_int steals;
+} APEX_Pool;
+
+typedef struct APEX_Worker
+{
+    APEX_Pool *pool;
+    int id;
+} APEX_Worker;
+
+/*
+ * Returns the index of the program of filename, loading it the first time
+ * it is seen, -1 if out of memory
+ */
+static int
+find_program(APEX_Pool *pool, const char *filename, int *capacity)
+{
+    APEX_Program *grown;
+    APEX_Program *program;
+    int i;
+
+    for (i = 0; i < pool->num_programs; i++)
+    {
+        if (strcmp(pool->programs[i].filename, filename) == 0)
+        {
+            return i;
+        }
+    }
+
+    if (pool->num_programs == *capacity)
+    {
+        *capacity = *capacity ? 2 * *capacity : 16;
+        grown = realloc(pool->programs, *capacity * sizeof(APEX_Program));
+        if (!grown)
+        {
+            return -1;
+        }
+        pool->programs = grown;
+    }
+
+    program = &pool->programs[pool->num_programs];
+    program->filename = strdup(filename);
+    if (!program->filename)
+    {
+        return -1;
+    }
+
+    program->cpu = APEX_cpu_init(filename, "simulate", 0);
+    if (program->cpu)
+    {
+        APEX_checkpoint_save(program->cpu, &program->initial);
+    }
+    else
+    {
+        fprintf(stderr, "APEX_Error: Unable to load %s\n", filename);
+    }
+    return pool->num_programs++;
+}
+
+/*
+ * Reads the jobs of a manifest, one per line: input file, simulate or
+ * functional, and the limit. Blank lines and lines starting with # are
+ * skipped.
+ *
+ * Returns FALSE on a malformed line or out of memory
+ */
+static int
+read_manifest(APEX_Pool *pool, const char *manifest)
+{
+    char filename[MANIFEST_MAX_PATH];
+    char mode[16];
+    char *line = NULL;
+    size_t line_size = 0;
+    int program_capacity = 0;
+    int job_capacity = 0;
+    int line_number = 0;
+    int fields;
+    APEX_Job *grown;
+    APEX_Job *job;
+    FILE *fp;
+
+    fp = fopen(manifest, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open %s\n", manifest);
+        return FALSE;
+    }
+
+    while (getline(&line, &line_size, fp) != -1)
+    {
+        line_number++;
+        fields = sscanf(line, "%4095s %15s", filename, mode);
+        if (fields <= 0 || filename[0] == '#')
+        {
+            continue;
+        }
+
+        if (pool->num_jobs == job_capacity)
+        {
+            job_capacity = job_capacity ? 2 * job_capacity : 64;
+            grown = realloc(pool->jobs, job_capacity * sizeof(APEX_Job));
+            if (!grown)
+            {
+                break;
+            }
+            pool->jobs = grown;
+        }
+
+        job = &pool->jobs[pool->num_jobs];
+        memset(job, 0, sizeof(APEX_Job));
+        if (sscanf(line, "%4095s %15s %d", filename, mode, &job->limit) != 3
+            || (strcmp(mode, "simulate") != 0
+                && strcmp(mode, "functional") != 0))
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: expected <input_file> simulate|functional <limit>\n",
+                    manifest, line_number);
+            break;
+        }
+
+        job->mode = (strcmp(mode, "simulate") == 0) ? JOB_SIMULATE
+                                                    : JOB_FUNCTIONAL;
+        job->program = find_program(pool, filename, &program_capacity);
+        if (job->program < 0)
+        {
+            break;
+        }
+        pool->num_jobs++;
+    }
+
+    free(line);
+    if (!feof(fp))
+    {
+        fclose(fp);
+        return FALSE;
+    }
+    fclose(fp);
+    return TRUE;
+}
+
+/*
+ * Runs a job on cpu, a scratch CPU of the worker
+ */
+static void
+run_job(const APEX_Pool *pool, APEX_Job *job, APEX_CPU *cpu)
+{
+    const APEX_Program *program = &pool->programs[job->program];
+    APEX_Memory data_memory = cpu->data_memory;
+    int limit = job->limit > 0 ? job->limit : -1;
+
+    if (!program->cpu)
+    {
+        job->status = -1;
+        return;
+    }
+
+    /* Shares code memory with the program, nothing it owns is freed. Data
+     * memory is the worker's own */
+    *cpu = *program->cpu;
+    cpu->data_memory = data_memory;
+    cpu->block_cache = NULL;
+    cpu->block_cache_code = NULL;
+    cpu->jit_code = NULL;
+    cpu->jit_code_used = 0;
+    cpu->stream = NULL;
+    cpu->arena = NULL;
+    APEX_cpu_start_at(cpu, &program->initial);
+
+    if (job->mode == JOB_FUNCTIONAL)
+    {
+        job->status = APEX_functional_run(cpu, limit, -1);
+        APEX_translation_flush(cpu);
+    }
+    else
+    {
+        job->status = APEX_cpu_run_cycles(cpu, limit);
+    }
+
+    job->cycles = cpu->clock;
+    job->insns = cpu->insn_completed;
+}
+
+/*
+ * Takes a job from the bottom of the worker's own deque, or else from the
+ * top of another one's.
+ *
+ * Returns the job index, -1 once every deque is empty
+ */
+static int
+take_job(APEX_Pool *pool, int id)
+{
+    APEX_Job_Deque *deque = &pool->deques[id];
+    int job = -1;
+    int i;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top)
+    {
+        job = deque->jobs[--deque->bottom];
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    /* Jobs are never added, so empty deques stay empty */
+    for (i = 1; job < 0 && i < pool->num_workers; i++)
+    {
+        deque = &pool->deques[(id + i) % pool->num_workers];
+        pthread_mutex_lock(&deque->lock);
+        if (deque->bottom > deque->top)
+        {
+            job = deque->jobs[deque->top++];
+            atomic_fetch_add(&pool->steals, 1);
+        }
+        pthread_mutex_unlock(&deque->lock);
+    }
+    return job;
+}
+
+static void *
+manifest_worker(void *arg)
+{
+    APEX_Worker *worker = arg;
+    APEX_CPU *cpu;
+    int job;
+
+    cpu = malloc(sizeof(APEX_CPU));
+    if (!cpu)
+    {
+        return NULL;
+    }
+    APEX_memory_init(&cpu->data_memory, ENABLE_DATA_HUGE_PAGES);
+
+    while ((job = take_job(worker->pool, worker->id)) >= 0)
+    {
+        run_job(worker->pool, &worker->pool->jobs[job], cpu);
+    }
+
+    APEX_memory_free(&cpu->data_memory);
+    free(cpu);
+    return NULL;
+}
+
+/*
+ * Writes the result of every job, in manifest order
+ */
+static int
+write_results(const APEX_Pool *pool, const char *results)
+{
+    static const char *const status_names[] = {
+        [RUN_RETIRED] = "Stopped",
+        [RUN_HALTED] = "Complete",
+        [RUN_DEADLOCKED] = "Deadlocked",
+        [RUN_LEFT_CODE] = "Faulted",
+    };
+    const APEX_Job *job;
+    FILE *fp;
+    int i;
+
+    fp = fopen(results, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open %s\n", results);
+        return FALSE;
+    }
+
+    for (i = 0; i < pool->num_jobs; i++)
+    {
+        job = &pool->jobs[i];
+        fprintf(fp, "%s %s %d: %s, cycles = %d instructions = %d\n",
+                pool->programs[job->program].filename,
+                job->mode == JOB_SIMULATE ? "simulate" : "functional",
+                job->limit,
+                job->status < 0 ? "Failed" : status_names[job->status],
+                job->cycles, job->insns);
+    }
+
+    return fclose(fp) == 0;
+}
+
+/*
+ * Runs the jobs on num_threads workers, one per online core if not
+ * positive, each starting with a contiguous share of the jobs.
+ *
+ * Returns FALSE if out of memory
+ */
+static int
+run_pool(APEX_Pool *pool, int num_threads)
+{
+    APEX_Worker *workers;
+    pthread_t *threads;
+    int ok = TRUE;
+    int first;
+    int last;
+    int i;
+
+    pool->num_workers = num_threads > 0 ? num_threads
+                                        : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (pool->num_workers < 1)
+    {
+        pool->num_workers = 1;
+    }
+    pool->deques = calloc(pool->num_workers, sizeof(APEX_Job_Deque));
+    workers = calloc(pool->num_workers, sizeof(APEX_Worker));
+    threads = calloc(pool->num_workers, sizeof(pthread_t));
+    ok = pool->deques && workers && threads;
+
+    for (i = 0; ok && i < pool->num_workers; i++)
+    {
+        first = (int)((long long)pool->num_jobs * i / pool->num_workers);
+        last = (int)((long long)pool->num_jobs * (i + 1) / pool->num_workers);
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->deques[i].jobs = malloc((last - first + 1) * sizeof(int));
+        ok = pool->deques[i].jobs != NULL;
+        while (ok && first < last)
+        {
+            pool->deques[i].jobs[pool->deques[i].bottom++] = first++;
+        }
+        workers[i].pool = pool;
+        workers[i].id = i;
+    }
+
+    if (ok)
+    {
+        for (pool->num_started = 0; pool->num_started < pool->num_workers;
+             pool->num_started++)
+        {
+            if (pthread_create(&threads[pool->num_started], NULL,
+                               manifest_worker, &workers[pool->num_started])
+                != 0)
+            {
+                break;
+            }
+        }
+        if (pool->num_started == 0)
+        {
+            /* Without threads the first worker steals every job here */
+            manifest_worker(&workers[0]);
+        }
+        for (i = 0; i < pool->num_started; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    free(workers);
+    free(threads);
+    return ok;
+}
+
+/*
+ * Runs every job of a manifest on num_threads workers, see run_pool, and
+ * writes their results.
+ *
+ * Returns FALSE if the manifest or the results could not be handled
+ */
+int
+APEX_manifest_run(const char *manifest, const char *results, int num_threads)
+{
+    APEX_Pool pool;
+    int ok;
+    int i;
+
+    memset(&pool, 0, sizeof(pool));
+    atomic_init(&pool.steals, 0);
+
+    ok = read_manifest(&pool, manifest) && run_pool(&pool, num_threads)
+         && write_results(&pool, results);
+    if (ok)
+    {
+        printf("APEX_MANIFEST: Jobs = %d programs = %d threads = %d steals = %d\n",
+               pool.num_jobs, pool.num_programs,
+               pool.num_started ? pool.num_started : 1,
+               atomic_load(&pool.steals));
+    }
+
+    for (i = 0; pool.deques && i < pool.num_workers; i++)
+    {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+        free(pool.deques[i].jobs);
+    }
+    for (i = 0; i < pool.num_programs; i++)
+    {
+        if (pool.programs[i].cpu)
+        {
+            APEX_checkpoint_free(&pool.programs[i].initial);
+            APEX_cpu_stop(pool.programs[i].cpu);
+        }
+        free(pool.programs[i].filename);
+    }
+    free(pool.programs);
+    free(pool.jobs);
+    free(pool.deques);
+    return ok;
+}
@@ -0,0 +1,625 @@
+/*
+ * apex_memory.c
+ * Contains data memory: a sparse memory of 32-bit words over the whole
+ * 32-bit address space. A directory of page tables maps the page number of
+ * an address to its page, which is mapped in the first time it is written,
+ * so a program only pays for the pages it touches. The page accessed last
+ * is cached in APEX_Memory, see APEX_memory_load and APEX_memory_store.
+ *
+ * Pages written since APEX_memory_mark_clean are dirty. The first store to
+ * a clean page moves it to a copy and keeps what it held, so the words a
+ * run changed can be told apart from the ones it was given. Clean pages are
+ * never written, which lets APEX_memory_map_image map a data image in as
+ * they are, shared by every simulation of it
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Bytes of a page */
+#define DATA_PAGE_BYTES (DATA_PAGE_WORDS * sizeof(int))
+
+/* Page table entry */
+struct APEX_Page
+{
+    int *words;                    /* NULL if never mapped in, read-only if clean */
+    const int *clean;              /* Words before it was dirtied, NULL if clean */
+};
+
+/* One mapping pages are carved out of, or a data image */
+struct APEX_Memory_Chunk
+{
+    void *base;
+    size_t bytes;
+};
+
+/* What a page mapped in by a store held before, and what memory reads as
+ * where nothing is mapped */
+static const int zero_page[DATA_PAGE_WORDS];
+
+/*
+ * Sets up memory with no page mapped in. Pages are taken from huge pages
+ * if huge_pages is set and the kernel agrees
+ */
+void
+APEX_memory_init(APEX_Memory *memory, int huge_pages)
+{
+    memset(memory, 0, sizeof(*memory));
+    memory->last_page = DATA_NO_PAGE;
+    memory->store_page = DATA_NO_PAGE;
+    memory->huge_pages = huge_pages;
+}
+
+/*
+ * Unmaps every page of memory, which reads as zeros again after
+ */
+void
+APEX_memory_free(APEX_Memory *memory)
+{
+    int i;
+
+    if (memory->directory)
+    {
+        for (i = 0; i < DATA_DIRECTORY_SIZE; i++)
+        {
+            free(memory->directory[i]);
+        }
+        free(memory->directory);
+    }
+    for (i = 0; i < memory->num_chunks; i++)
+    {
+        munmap(memory->chunks[i].base, memory->chunks[i].bytes);
+    }
+    free(memory->chunks);
+
+    APEX_memory_init(memory, memory->huge_pages);
+}
+
+/* Memory is needed for every store, there is no way to go on without it */
+static void
+out_of_memory(void)
+{
+    fprintf(stderr, "APEX_Error: Out of memory for data memory pages\n");
+    exit(1);
+}
+
+/*
+ * Records a mapping of memory, to be unmapped with it
+ */
+static void
+add_chunk(APEX_Memory *memory, void *base, size_t bytes)
+{
+    struct APEX_Memory_Chunk *grown;
+
+    if (memory->num_chunks == memory->chunk_capacity)
+    {
+        memory->chunk_capacity = memory->chunk_capacity
+                                     ? 2 * memory->chunk_capacity
+                                     : 16;
+        grown = realloc(memory->chunks, memory->chunk_capacity
+                                            * sizeof(*memory->chunks));
+        if (!grown)
+        {
+            out_of_memory();
+        }
+        memory->chunks = grown;
+    }
+    memory->chunks[memory->num_chunks].base = base;
+    memory->chunks[memory->num_chunks].bytes = bytes;
+    memory->num_chunks++;
+}
+
+/*
+ * Maps a chunk of at least pages zeroed pages, which the next pages
+ * mapped in are taken from. Huge page chunks are aligned to huge pages,
+ * so that the kernel can back them with huge pages
+ */
+static void
+map_chunk(APEX_Memory *memory, int pages)
+{
+    size_t bytes;
+    size_t align = memory->huge_pages ? ARENA_HUGE_PAGE_SIZE : DATA_PAGE_BYTES;
+    unsigned char *base;
+    size_t head;
+
+    if (pages < DATA_CHUNK_PAGES)
+    {
+        pages = DATA_CHUNK_PAGES;
+    }
+    bytes = ((size_t)pages * DATA_PAGE_BYTES + align - 1) & ~(align - 1);
+
+    /* Mapped with room to trim it down to an aligned chunk */
+    base = mmap(NULL, bytes + align - DATA_PAGE_BYTES, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        out_of_memory();
+    }
+    head = (align - (uintptr_t)base % align) % align;
+    if (head)
+    {
+        munmap(base, head);
+    }
+    if (align - DATA_PAGE_BYTES - head)
+    {
+        munmap(base + head + bytes, align - DATA_PAGE_BYTES - head);
+    }
+    base += head;
+
+#ifdef MADV_HUGEPAGE
+    if (memory->huge_pages)
+    {
+        madvise(base, bytes, MADV_HUGEPAGE);
+    }
+#endif
+
+    add_chunk(memory, base, bytes);
+    memory->chunk_next = (int *)base;
+    memory->chunk_pages_left = bytes / DATA_PAGE_BYTES;
+}
+
+/*
+ * Takes a zeroed page from the last chunk
+ */
+static int *
+alloc_page(APEX_Memory *memory)
+{
+    int *words;
+
+    if (memory->chunk_pages_left == 0)
+    {
+        map_chunk(memory, DATA_CHUNK_PAGES);
+    }
+    words = memory->chunk_next;
+    memory->chunk_next += DATA_PAGE_WORDS;
+    memory->chunk_pages_left--;
+    return words;
+}
+
+/*
+ * Returns the page table entry of page number page, NULL if its table was
+ * never needed
+ */
+static struct APEX_Page *
+find_entry(const APEX_Memory *memory, unsigned int page)
+{
+    struct APEX_Page *table;
+
+    if (!memory->directory || page >= DATA_NUM_PAGES)
+    {
+        return NULL;
+    }
+    table = memory->directory[page >> DATA_TABLE_SHIFT];
+    return table ? &table[page & (DATA_TABLE_SIZE - 1)] : NULL;
+}
+
+/*
+ * Returns the page table entry of page number page, making its table if
+ * need be
+ */
+static struct APEX_Page *
+make_entry(APEX_Memory *memory, unsigned int page)
+{
+    struct APEX_Page **table;
+
+    if (!memory->directory)
+    {
+        memory->directory = calloc(DATA_DIRECTORY_SIZE,
+                                   sizeof(struct APEX_Page *));
+        if (!memory->directory)
+        {
+            out_of_memory();
+        }
+    }
+
+    table = &memory->directory[page >> DATA_TABLE_SHIFT];
+    if (!*table)
+    {
+        *table = calloc(DATA_TABLE_SIZE, sizeof(struct APEX_Page));
+        if (!*table)
+        {
+            out_of_memory();
+        }
+    }
+
+    return &(*table)[page & (DATA_TABLE_SIZE - 1)];
+}
+
+/*
+ * Returns the page table entry of page number page with the page mapped
+ * in. A page mapped in here held zeros before, and is dirty
+ */
+static struct APEX_Page *
+map_page(APEX_Memory *memory, unsigned int page)
+{
+    struct APEX_Page *entry = make_entry(memory, page);
+
+    if (!entry->words)
+    {
+        entry->words = alloc_page(memory);
+        entry->clean = zero_page;
+        memory->num_pages++;
+    }
+    return entry;
+}
+
+/*
+ * Returns the words of page number page, NULL if it was never mapped in
+ */
+const int *
+APEX_memory_page(const APEX_Memory *memory, unsigned int page)
+{
+    const struct APEX_Page *entry = find_entry(memory, page);
+
+    return entry ? entry->words : NULL;
+}
+
+/*
+ * Returns what page number page held before it was dirtied, zeros if it
+ * was mapped in since. Returns NULL if the page is clean
+ */
+const int *
+APEX_memory_clean_page(const APEX_Memory *memory, unsigned int page)
+{
+    const struct APEX_Page *entry = find_entry(memory, page);
+
+    return entry ? entry->clean : NULL;
+}
+
+/*
+ * Returns the number of the first page mapped in from page number page on,
+ * and dirty if dirty_only is set, DATA_NO_PAGE if there is none
+ */
+static unsigned int
+next_page(const APEX_Memory *memory, unsigned int page, int dirty_only)
+{
+    const struct APEX_Page *table;
+    const struct APEX_Page *entry;
+
+    if (!memory->directory)
+    {
+        return DATA_NO_PAGE;
+    }
+    for (; page < DATA_NUM_PAGES; page++)
+    {
+        table = memory->directory[page >> DATA_TABLE_SHIFT];
+        if (!table)
+        {
+            /* Skip to the last page of the table, the loop moves on */
+            page |= DATA_TABLE_SIZE - 1;
+            continue;
+        }
+        entry = &table[page & (DATA_TABLE_SIZE - 1)];
+        if (entry->words && (entry->clean || !dirty_only))
+        {
+            return page;
+        }
+    }
+    return DATA_NO_PAGE;
+}
+
+/*
+ * Returns the number of the first page mapped in from page number page on,
+ * DATA_NO_PAGE if there is none
+ */
+unsigned int
+APEX_memory_next_page(const APEX_Memory *memory, unsigned int page)
+{
+    return next_page(memory, page, FALSE);
+}
+
+/*
+ * Returns the number of the first dirty page from page number page on,
+ * DATA_NO_PAGE if there is none
+ */
+unsigned int
+APEX_memory_next_dirty_page(const APEX_Memory *memory, unsigned int page)
+{
+    return next_page(memory, page, TRUE);
+}
+
+/*
+ * Makes every page clean, as the state later changes are told apart from.
+ * The originals kept of dirtied pages are dropped, their space is only
+ * given back with the memory
+ */
+void
+APEX_memory_mark_clean(APEX_Memory *memory)
+{
+    struct APEX_Page *table;
+    int i, j;
+
+    for (i = 0; memory->directory && i < DATA_DIRECTORY_SIZE; i++)
+    {
+        table = memory->directory[i];
+        for (j = 0; table && j < DATA_TABLE_SIZE; j++)
+        {
+            table[j].clean = NULL;
+        }
+    }
+
+    /* The next store to any page has to go through APEX_memory_touch */
+    memory->store_page = DATA_NO_PAGE;
+    memory->store_words = NULL;
+}
+
+/*
+ * Returns the word at address, zero if it was never written. Leaves the
+ * last-page cache alone, so that memory can be read by anyone
+ */
+int
+APEX_memory_peek(const APEX_Memory *memory, unsigned int address)
+{
+    const int *words = APEX_memory_page(memory, address >> DATA_PAGE_SHIFT);
+
+    return words ? words[address & DATA_PAGE_MASK] : 0;
+}
+
+/*
+ * APEX_memory_load of an address off the cached page. A page that was never
+ * written reads as zeros without being mapped in
+ */
+int
+APEX_memory_load_miss(APEX_Memory *memory, unsigned int address)
+{
+    unsigned int page = address >> DATA_PAGE_SHIFT;
+    const int *words = APEX_memory_page(memory, page);
+
+    if (!words)
+    {
+        return 0;
+    }
+    memory->last_page = page;
+    memory->last_words = (int *)words;
+    return words[address & DATA_PAGE_MASK];
+}
+
+/*
+ * Gives the clean page of entry a copy of its words to be written, the
+ * words it has being kept as the original. The page is dirty after
+ */
+static void
+dirty_page(APEX_Memory *memory, struct APEX_Page *entry)
+{
+    int *words = alloc_page(memory);
+
+    memcpy(words, entry->words, DATA_PAGE_BYTES);
+    entry->clean = entry->words;
+    entry->words = words;
+    memory->num_clean++;
+}
+
+/*
+ * Returns the word at address to be written, mapping its page in on first
+ * touch and dirtying it, and caching it for loads and stores
+ */
+int *
+APEX_memory_touch(APEX_Memory *memory, unsigned int address)
+{
+    unsigned int page = address >> DATA_PAGE_SHIFT;
+    struct APEX_Page *entry = map_page(memory, page);
+
+    if (!entry->clean)
+    {
+        dirty_page(memory, entry);
+    }
+
+    memory->last_page = page;
+    memory->last_words = entry->words;
+    memory->store_page = page;
+    memory->store_words = entry->words;
+    return &entry->words[address & DATA_PAGE_MASK];
+}
+
+/*
+ * Sets page number page to words. As APEX_PAGE_CLEAN the page is clean
+ * after, as APEX_PAGE_DIRTY it is dirty and held zeros before, and as
+ * APEX_PAGE_ORIGINAL words are what the page, which must be dirty, held
+ * before
+ */
+void
+APEX_memory_put_page(APEX_Memory *memory, unsigned int page, const int *words,
+                     int kind)
+{
+    struct APEX_Page *entry = map_page(memory, page);
+    int *clean;
+
+    if (kind == APEX_PAGE_ORIGINAL)
+    {
+        clean = alloc_page(memory);
+        memcpy(clean, words, DATA_PAGE_BYTES);
+        entry->clean = clean;
+        memory->num_clean++;
+        return;
+    }
+
+    if (!entry->clean)
+    {
+        /* A clean page may be mapped from an image, it is never written */
+        entry->words = alloc_page(memory);
+    }
+    memcpy(entry->words, words, DATA_PAGE_BYTES);
+    entry->clean = kind == APEX_PAGE_DIRTY ? zero_page : NULL;
+
+    /* The store cache may hold the page, which is no longer dirty */
+    memory->store_page = DATA_NO_PAGE;
+    memory->store_words = NULL;
+}
+
+/*
+ * Copies num_words words to data memory from address on, into pages that
+ * are clean after
+ */
+static void
+copy_words(APEX_Memory *memory, unsigned int address, const int *words,
+           size_t num_words)
+{
+    struct APEX_Page *entry;
+    unsigned int offset;
+    size_t n;
+    int *fresh;
+
+    while (num_words > 0)
+    {
+        entry = make_entry(memory, address >> DATA_PAGE_SHIFT);
+        fresh = alloc_page(memory);
+        if (entry->words)
+        {
+            memcpy(fresh, entry->words, DATA_PAGE_BYTES);
+        }
+        else
+        {
+            memory->num_pages++;
+        }
+        entry->words = fresh;
+        entry->clean = NULL;
+
+        offset = address & DATA_PAGE_MASK;
+        n = DATA_PAGE_WORDS - offset;
+        if (n > num_words)
+        {
+            n = num_words;
+        }
+        memcpy(&entry->words[offset], words, n * sizeof(int));
+        address += n;
+        words += n;
+        num_words -= n;
+    }
+}
+
+/*
+ * Maps the data image filename, raw words in the byte order of the host,
+ * into memory from address base on, as part of the state memory starts
+ * in: the pages it covers are clean after.
+ *
+ * The file is mapped private and read-only. If base is at the start of a
+ * page, pages of memory the image covers whole and that were not mapped in
+ * yet are its pages, so simulations of the same image share them until
+ * they store to them. The rest of the image is copied.
+ *
+ * Returns FALSE if the file is not a data image
+ */
+int
+APEX_memory_map_image(APEX_Memory *memory, const char *filename,
+                      unsigned int base)
+{
+    struct APEX_Page *entry;
+    struct stat st;
+    size_t num_words;
+    size_t i;
+    int *image;
+    int mapped = 0;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open data image %s\n",
+                filename);
+        return FALSE;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size % sizeof(int) != 0
+        || (unsigned long long)st.st_size / sizeof(int)
+               > (unsigned long long)DATA_NUM_PAGES * DATA_PAGE_WORDS)
+    {
+        fprintf(stderr, "APEX_Error: %s is not a data image of whole words "
+                "that fits data memory\n",
+                filename);
+        close(fd);
+        return FALSE;
+    }
+    num_words = st.st_size / sizeof(int);
+    if (num_words == 0)
+    {
+        close(fd);
+        return TRUE;
+    }
+
+    image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+    {
+        fprintf(stderr, "APEX_Error: Unable to map data image %s\n",
+                filename);
+        return FALSE;
+    }
+
+    i = 0;
+    if ((base & DATA_PAGE_MASK) == 0)
+    {
+        for (; i + DATA_PAGE_WORDS <= num_words; i += DATA_PAGE_WORDS)
+        {
+            entry = make_entry(memory, ((base + i) >> DATA_PAGE_SHIFT)
+                                           & (DATA_NUM_PAGES - 1));
+            if (entry->words)
+            {
+                copy_words(memory, base + i, &image[i], DATA_PAGE_WORDS);
+                continue;
+            }
+            entry->words = &image[i];
+            entry->clean = NULL;
+            memory->num_pages++;
+            mapped++;
+        }
+    }
+    copy_words(memory, base + i, &image[i], num_words - i);
+
+    if (mapped)
+    {
+        add_chunk(memory, image, st.st_size);
+    }
+    else
+    {
+        munmap(image, st.st_size);
+    }
+
+    /* Neither cache may hold a page that changed */
+    memory->last_page = DATA_NO_PAGE;
+    memory->last_words = NULL;
+    memory->store_page = DATA_NO_PAGE;
+    memory->store_words = NULL;
+    return TRUE;
+}
+
+/*
+ * Makes dest a copy of src, with pages of its own, dirty where those of src
+ * are. The pages dest had are unmapped first
+ */
+void
+APEX_memory_copy(APEX_Memory *dest, const APEX_Memory *src)
+{
+    const int *clean;
+    unsigned int page;
+
+    APEX_memory_free(dest);
+    if (src->num_pages == 0)
+    {
+        return;
+    }
+
+    /* All in one chunk */
+    map_chunk(dest, src->num_pages + src->num_clean);
+    for (page = APEX_memory_next_page(src, 0); page != DATA_NO_PAGE;
+         page = APEX_memory_next_page(src, page + 1))
+    {
+        clean = APEX_memory_clean_page(src, page);
+        APEX_memory_put_page(dest, page, APEX_memory_page(src, page),
+                             clean ? APEX_PAGE_DIRTY : APEX_PAGE_CLEAN);
+        if (clean && clean != zero_page)
+        {
+            APEX_memory_put_page(dest, page, clean, APEX_PAGE_ORIGINAL);
+        }
+    }
+}
@@ -0,0 +1,367 @@
+/*
+ * apex_snapshot.c
+ * Contains snapshots: the complete state of a CPU between two cycles, the
+ * pipeline latches included, saved to a binary file and mapped back in to
+ * continue the same run cycle for cycle
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Identifies a snapshot file, the version follows it */
+static const char snapshot_magic[8] = "APEXSNAP";
+
+/* Start of a snapshot file, in the byte order of the host that wrote it,
+ * followed by num_records pages of data memory. The program is not saved, it
+ * is loaded again by APEX_cpu_init and must hash to code_hash */
+typedef struct APEX_Snapshot
+{
+    char magic[8];
+    unsigned int version;          /* APEX_SNAPSHOT_VERSION */
+    unsigned int size;             /* Bytes of this struct, set by the variant */
+    unsigned int forwarding;       /* APEX_FORWARDING of the writer */
+    unsigned int code_slots;       /* Code memory slots, padding included */
+    unsigned long long code_hash;  /* See APEX_snapshot_code_hash */
+    unsigned int num_records;      /* APEX_Snapshot_Page following */
+
+    int pc;
+    int clock;
+    int insn_completed;
+    int regs[REG_FILE_SIZE];
+    unsigned int regs_pending;
+    unsigned int regs_written;
+    int data_forward_buffer[REG_FILE_SIZE]; /* Zero without forwarding */
+    unsigned int data_forward_valid;
+    int zero_flag;
+    int fetch_from_next_cycle;
+    int decode_stall_cycles;
+    int fetch_stall_cycles;
+    int run_status;
+    CPU_Stage fetch;
+    CPU_Latches cur_latches;       /* Read in the next cycle */
+    CPU_Latches next_latches;      /* Written in the next cycle */
+} APEX_Snapshot;
+
+/* A data memory page mapped in when the snapshot was taken, or what a dirty
+ * page held before, which follows the page */
+typedef struct APEX_Snapshot_Page
+{
+    unsigned int page;             /* Page number */
+    unsigned int kind;             /* APEX_PAGE_* */
+    int words[DATA_PAGE_WORDS];
+} APEX_Snapshot_Page;
+
+/*
+ * Writes one page record of kind after the snapshot.
+ *
+ * Returns FALSE if it could not be written
+ */
+static int
+write_page(unsigned int page, unsigned int kind, const int *words, FILE *fp)
+{
+    return fwrite(&page, sizeof(page), 1, fp) == 1
+           && fwrite(&kind, sizeof(kind), 1, fp) == 1
+           && fwrite(words, sizeof(int), DATA_PAGE_WORDS, fp)
+                  == DATA_PAGE_WORDS;
+}
+
+/*
+ * Writes the data memory pages of cpu after the snapshot, with what the
+ * dirty ones held before unless that was zeros.
+ *
+ * Returns the number of records written, -1 if not all of them could be
+ */
+static int
+write_pages(const APEX_CPU *cpu, FILE *fp)
+{
+    const APEX_Memory *memory = &cpu->data_memory;
+    static const int zeros[DATA_PAGE_WORDS];
+    const int *clean;
+    unsigned int page;
+    int records = 0;
+
+    for (page = APEX_memory_next_page(memory, 0); page != DATA_NO_PAGE;
+         page = APEX_memory_next_page(memory, page + 1))
+    {
+        clean = APEX_memory_clean_page(memory, page);
+        if (!write_page(page, clean ? APEX_PAGE_DIRTY : APEX_PAGE_CLEAN,
+                        APEX_memory_page(memory, page), fp))
+        {
+            return -1;
+        }
+        records++;
+
+        if (clean && memcmp(clean, zeros, sizeof(zeros)) != 0)
+        {
+            if (!write_page(page, APEX_PAGE_ORIGINAL, clean, fp))
+            {
+                return -1;
+            }
+            records++;
+        }
+    }
+    return records;
+}
+
+/*
+ * FNV-1a of code memory, which tells whether a snapshot was taken running
+ * the program cpu holds
+ */
+unsigned long long
+APEX_snapshot_code_hash(const APEX_CPU *cpu)
+{
+    const unsigned char *bytes = (const unsigned char *)cpu->code_memory;
+    size_t size = cpu->code_memory_slots * sizeof(APEX_Instruction);
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/*
+ * Saves the state of cpu, which must be between two cycles, to filename.
+ * The file is written beside filename and renamed over it, so a crash
+ * leaves the previous snapshot in place.
+ *
+ * Returns FALSE if the file could not be written
+ */
+int
+APEX_snapshot_save(const APEX_CPU *cpu, const char *filename)
+{
+    APEX_Snapshot snapshot;
+    char temp[4096];
+    FILE *fp;
+    int records;
+    int written;
+
+    if (cpu->stream)
+    {
+        fprintf(stderr, "APEX_Error: The decoupled mode cannot be snapshotted\n");
+        return FALSE;
+    }
+
+    /* Zeroed, so that struct padding is written as zeros */
+    memset(&snapshot, 0, sizeof(snapshot));
+    memcpy(snapshot.magic, snapshot_magic, sizeof(snapshot.magic));
+    snapshot.version = APEX_SNAPSHOT_VERSION;
+    snapshot.size = sizeof(snapshot);
+    snapshot.forwarding = APEX_FORWARDING;
+    snapshot.code_slots = cpu->code_memory_slots;
+    snapshot.code_hash = APEX_snapshot_code_hash(cpu);
+
+    snapshot.pc = cpu->pc;
+    snapshot.clock = cpu->clock;
+    snapshot.insn_completed = cpu->insn_completed;
+    memcpy(snapshot.regs, cpu->regs, sizeof(snapshot.regs));
+    snapshot.regs_pending = cpu->regs_pending;
+    snapshot.regs_written = cpu->regs_written;
+#if APEX_FORWARDING
+    memcpy(snapshot.data_forward_buffer, cpu->data_forward_buffer,
+           sizeof(snapshot.data_forward_buffer));
+    snapshot.data_forward_valid = cpu->data_forward_valid;
+#endif
+    snapshot.zero_flag = cpu->zero_flag;
+    snapshot.fetch_from_next_cycle = cpu->fetch_from_next_cycle;
+    snapshot.decode_stall_cycles = cpu->decode_stall_cycles;
+    snapshot.fetch_stall_cycles = cpu->fetch_stall_cycles;
+    snapshot.run_status = cpu->run_status;
+    snapshot.fetch = cpu->fetch;
+    snapshot.cur_latches = *cpu->cur_latches;
+    snapshot.next_latches = *cpu->next_latches;
+
+    if (snprintf(temp, sizeof(temp), "%s.tmp", filename) >= (int)sizeof(temp))
+    {
+        fprintf(stderr, "APEX_Error: Snapshot file name too long\n");
+        return FALSE;
+    }
+
+    fp = fopen(temp, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write snapshot %s\n", temp);
+        return FALSE;
+    }
+    /* The header is written again once the pages are counted */
+    written = fwrite(&snapshot, sizeof(snapshot), 1, fp) == 1
+              && (records = write_pages(cpu, fp)) >= 0;
+    if (written)
+    {
+        snapshot.num_records = records;
+        written = fseek(fp, 0, SEEK_SET) == 0
+                  && fwrite(&snapshot, sizeof(snapshot), 1, fp) == 1;
+    }
+    if (fclose(fp) != 0 || !written || rename(temp, filename) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write snapshot %s\n", filename);
+        unlink(temp);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Checks that snapshot was written by this variant for the program hashing
+ * to code_hash, with code_slots slots unless negative, printing what does
+ * not match otherwise
+ */
+static int
+snapshot_valid(const APEX_Snapshot *snapshot, const char *filename,
+               unsigned long long code_hash, int code_slots)
+{
+    if (memcmp(snapshot->magic, snapshot_magic, sizeof(snapshot->magic)) != 0)
+    {
+        fprintf(stderr, "APEX_Error: %s is not a snapshot\n", filename);
+        return FALSE;
+    }
+    if (snapshot->version != APEX_SNAPSHOT_VERSION
+        || snapshot->size != sizeof(APEX_Snapshot)
+        || snapshot->forwarding != APEX_FORWARDING)
+    {
+        fprintf(stderr, "APEX_Error: Snapshot %s is of version %u, from a "
+                "different pipeline variant or build\n",
+                filename, snapshot->version);
+        return FALSE;
+    }
+    if ((code_slots >= 0 && snapshot->code_slots != (unsigned int)code_slots)
+        || snapshot->code_hash != code_hash)
+    {
+        fprintf(stderr, "APEX_Error: Snapshot %s was taken with another "
+                "program\n", filename);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Maps the snapshot in filename and loads it into cpu, see
+ * snapshot_valid for code_hash and code_slots
+ */
+static int
+load_snapshot(APEX_CPU *cpu, const char *filename,
+              unsigned long long code_hash, int code_slots)
+{
+    const APEX_Snapshot *snapshot;
+    const APEX_Snapshot_Page *pages;
+    struct stat st;
+    unsigned int i;
+    int fd;
+    int valid;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open snapshot %s\n", filename);
+        return FALSE;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(APEX_Snapshot)
+        || (st.st_size - sizeof(APEX_Snapshot)) % sizeof(APEX_Snapshot_Page))
+    {
+        fprintf(stderr, "APEX_Error: %s is not a snapshot of this build\n",
+                filename);
+        close(fd);
+        return FALSE;
+    }
+
+    snapshot = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (snapshot == MAP_FAILED)
+    {
+        fprintf(stderr, "APEX_Error: Unable to map snapshot %s\n", filename);
+        return FALSE;
+    }
+
+    valid = snapshot_valid(snapshot, filename, code_hash, code_slots);
+    if (valid && snapshot->num_records != (st.st_size - sizeof(APEX_Snapshot))
+                                              / sizeof(APEX_Snapshot_Page))
+    {
+        fprintf(stderr, "APEX_Error: Snapshot %s is cut short\n", filename);
+        valid = FALSE;
+    }
+
+    pages = (const APEX_Snapshot_Page *)(snapshot + 1);
+    for (i = 0; valid && i < snapshot->num_records; i++)
+    {
+        if (pages[i].page >= DATA_NUM_PAGES
+            || pages[i].kind > APEX_PAGE_ORIGINAL)
+        {
+            fprintf(stderr, "APEX_Error: Snapshot %s is damaged\n", filename);
+            valid = FALSE;
+        }
+    }
+    if (valid)
+    {
+        cpu->pc = snapshot->pc;
+        cpu->clock = snapshot->clock;
+        cpu->insn_completed = snapshot->insn_completed;
+        memcpy(cpu->regs, snapshot->regs, sizeof(cpu->regs));
+        cpu->regs_pending = snapshot->regs_pending;
+        cpu->regs_written = snapshot->regs_written;
+#if APEX_FORWARDING
+        memcpy(cpu->data_forward_buffer, snapshot->data_forward_buffer,
+               sizeof(cpu->data_forward_buffer));
+        cpu->data_forward_valid = snapshot->data_forward_valid;
+#endif
+        APEX_memory_free(&cpu->data_memory);
+        for (i = 0; i < snapshot->num_records; i++)
+        {
+            APEX_memory_put_page(&cpu->data_memory, pages[i].page,
+                                 pages[i].words, pages[i].kind);
+        }
+        cpu->zero_flag = snapshot->zero_flag;
+        cpu->fetch_from_next_cycle = snapshot->fetch_from_next_cycle;
+        cpu->decode_stall_cycles = snapshot->decode_stall_cycles;
+        cpu->fetch_stall_cycles = snapshot->fetch_stall_cycles;
+        cpu->run_status = snapshot->run_status;
+        cpu->fetch = snapshot->fetch;
+        cpu->latch_bank[0] = snapshot->cur_latches;
+        cpu->latch_bank[1] = snapshot->next_latches;
+        cpu->cur_latches = &cpu->latch_bank[0];
+        cpu->next_latches = &cpu->latch_bank[1];
+        cpu->stream_lost = FALSE;
+    }
+
+    munmap((void *)snapshot, st.st_size);
+    return valid;
+}
+
+/*
+ * Maps the snapshot in filename and loads it into cpu, which must hold the
+ * program the snapshot was taken with. The run goes on from the cycle the
+ * snapshot was taken at. Settings of cpu are left as they are.
+ *
+ * Returns FALSE if the file is not a snapshot cpu can take
+ */
+int
+APEX_snapshot_restore(APEX_CPU *cpu, const char *filename)
+{
+    return load_snapshot(cpu, filename, APEX_snapshot_code_hash(cpu),
+                         cpu->code_memory_slots);
+}
+
+/*
+ * APEX_snapshot_restore of a snapshot taken with a program hashing to
+ * code_hash, which may differ from that of cpu. It is for the caller to
+ * know that the instructions the snapshot depends on are the same in both
+ *
+ * Returns FALSE if the file is not such a snapshot
+ */
+int
+APEX_snapshot_resume(APEX_CPU *cpu, const char *filename,
+                     unsigned long long code_hash)
+{
+    return load_snapshot(cpu, filename, code_hash, -1);
+}
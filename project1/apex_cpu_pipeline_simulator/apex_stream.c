@@ -0,0 +1,212 @@
+/*
+ * apex_stream.c
+ * Contains the decoupled mode, in which the functional simulator runs ahead
+ * on its own thread and hands the pipeline the values of every instruction
+ * through a single-producer, single-consumer ring
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+struct APEX_Stream
+{
+    /* Written by the producer, each index on a cache line of its own */
+    _Alignas(CODE_MEMORY_ALIGN) atomic_uint head; /* Records published */
+    atomic_int done;               /* No record follows the published ones */
+    _Alignas(CODE_MEMORY_ALIGN) atomic_uint tail; /* Records consumed */
+    atomic_int stop;               /* The timing model wants no more */
+
+    /* Private to the producer */
+    _Alignas(CODE_MEMORY_ALIGN) unsigned int producer_head;
+    unsigned int producer_tail;    /* Last tail seen */
+    APEX_CPU functional;           /* State the functional thread runs on */
+
+    /* Private to the consumer */
+    _Alignas(CODE_MEMORY_ALIGN) unsigned int consumer_head; /* Last head seen */
+    unsigned int consumer_tail;
+
+    pthread_t thread;
+    _Alignas(CODE_MEMORY_ALIGN) APEX_Trace_Record ring[STREAM_RING_SIZE];
+};
+
+/* Makes the records written so far visible to the consumer */
+static void
+publish_records(APEX_Stream *stream)
+{
+    atomic_store_explicit(&stream->head, stream->producer_head,
+                          memory_order_release);
+}
+
+/*
+ * Waits for a free slot in the ring. The consumer's index is only read
+ * once the last value seen says the ring is full.
+ *
+ * Returns FALSE if the timing model stopped in the meantime
+ */
+static int
+wait_for_slot(APEX_Stream *stream)
+{
+    while (stream->producer_head - stream->producer_tail == STREAM_RING_SIZE)
+    {
+        if (atomic_load_explicit(&stream->stop, memory_order_relaxed))
+        {
+            return FALSE;
+        }
+
+        publish_records(stream);
+        stream->producer_tail
+            = atomic_load_explicit(&stream->tail, memory_order_acquire);
+        if (stream->producer_head - stream->producer_tail == STREAM_RING_SIZE)
+        {
+            sched_yield();
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Functional thread: runs the program until HALT, or until it leaves code
+ * memory, writing one record per instruction
+ */
+static void *
+stream_producer(void *arg)
+{
+    APEX_Stream *stream = arg;
+    APEX_CPU *cpu = &stream->functional;
+    APEX_Trace_Record *record;
+
+    while (wait_for_slot(stream))
+    {
+        record = &stream->ring[stream->producer_head % STREAM_RING_SIZE];
+        if (APEX_functional_trace(cpu, record) != RUN_RETIRED)
+        {
+            /* Neither HALT nor leaving code memory has anything to hand
+             * over */
+            break;
+        }
+
+        stream->producer_head++;
+        if (stream->producer_head % STREAM_PUBLISH_BATCH == 0)
+        {
+            publish_records(stream);
+        }
+    }
+
+    publish_records(stream);
+    atomic_store_explicit(&stream->done, TRUE, memory_order_release);
+    return NULL;
+}
+
+/*
+ * Starts the functional thread on a copy of the architectural state of
+ * cpu. Code memory is shared, neither side writes it.
+ *
+ * Returns NULL if the thread could not be started
+ */
+APEX_Stream *
+APEX_stream_start(const APEX_CPU *cpu)
+{
+    APEX_Stream *stream;
+    size_t bytes = (sizeof(APEX_Stream) + CODE_MEMORY_ALIGN - 1)
+                   & ~(size_t)(CODE_MEMORY_ALIGN - 1);
+
+    stream = aligned_alloc(CODE_MEMORY_ALIGN, bytes);
+    if (!stream)
+    {
+        return NULL;
+    }
+
+    atomic_init(&stream->head, 0);
+    atomic_init(&stream->done, FALSE);
+    atomic_init(&stream->tail, 0);
+    atomic_init(&stream->stop, FALSE);
+    stream->producer_head = 0;
+    stream->producer_tail = 0;
+    stream->consumer_head = 0;
+    stream->consumer_tail = 0;
+
+    /* The functional thread only steps, it needs no translation cache. It
+     * stores into a copy of data memory */
+    stream->functional = *cpu;
+    stream->functional.block_cache = NULL;
+    stream->functional.block_cache_code = NULL;
+    stream->functional.jit_code = NULL;
+    stream->functional.jit_code_used = 0;
+    stream->functional.stream = NULL;
+    stream->functional.arena = NULL;
+    APEX_memory_init(&stream->functional.data_memory,
+                     cpu->data_memory.huge_pages);
+    APEX_memory_copy(&stream->functional.data_memory, &cpu->data_memory);
+
+    if (pthread_create(&stream->thread, NULL, stream_producer, stream) != 0)
+    {
+        APEX_memory_free(&stream->functional.data_memory);
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+/*
+ * Takes the next record of the stream, waiting for the functional thread
+ * if it has not got there yet.
+ *
+ * Returns FALSE once the stream has ended
+ */
+int
+APEX_stream_next(APEX_Stream *stream, APEX_Trace_Record *record)
+{
+    while (stream->consumer_tail == stream->consumer_head)
+    {
+        /* Read done first, head is final once it is set */
+        if (atomic_load_explicit(&stream->done, memory_order_acquire))
+        {
+            stream->consumer_head
+                = atomic_load_explicit(&stream->head, memory_order_relaxed);
+            if (stream->consumer_tail == stream->consumer_head)
+            {
+                return FALSE;
+            }
+            break;
+        }
+
+        stream->consumer_head
+            = atomic_load_explicit(&stream->head, memory_order_acquire);
+        if (stream->consumer_tail == stream->consumer_head)
+        {
+            sched_yield();
+        }
+    }
+
+    *record = stream->ring[stream->consumer_tail % STREAM_RING_SIZE];
+    stream->consumer_tail++;
+    atomic_store_explicit(&stream->tail, stream->consumer_tail,
+                          memory_order_release);
+    return TRUE;
+}
+
+/*
+ * Stops the functional thread and frees the stream
+ */
+void
+APEX_stream_stop(APEX_Stream *stream)
+{
+    if (!stream)
+    {
+        return;
+    }
+
+    atomic_store_explicit(&stream->stop, TRUE, memory_order_relaxed);
+    pthread_join(stream->thread, NULL);
+    APEX_memory_free(&stream->functional.data_memory);
+    free(stream);
+}
@@ -0,0 +1,194 @@
+/*
+ * apex_sweep.c
+ * Contains the sweep driver, which runs the prefix of a program once and
+ * forks one child per configuration to run the rest. Children share the
+ * parsed code memory and the state of the prefix copy-on-write, and
+ * report through a table in shared memory
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Result of one configuration, written by its child */
+typedef struct APEX_Sweep_Result
+{
+    int done;                      /* Set last, the run went through */
+    int status;                    /* RUN_* */
+    int cycles;
+    int insns;
+    int decode_stall_cycles;
+    int fetch_stall_cycles;
+} APEX_Sweep_Result;
+
+/*
+ * Child: applies the options of config to cpu, which holds the state the
+ * prefix left, runs it from there and fills result.
+ *
+ * Returns FALSE if the configuration is not valid
+ */
+static int
+run_config(APEX_CPU *cpu, const char *config, APEX_Sweep_Result *result)
+{
+    char *options;
+    char *name;
+    char *value;
+    char *save;
+
+    /* The prefix is done, a configuration may only add to it. Children run
+     * side by side, so none of them keeps an incremental record */
+    cpu->fast_forward_insns = 0;
+    cpu->fast_forward_pc = 0;
+    cpu->incremental_dir = NULL;
+
+    options = strdup(config);
+    if (!options)
+    {
+        return FALSE;
+    }
+
+    for (name = strtok_r(options, " \t", &save); name;
+         name = strtok_r(NULL, " \t", &save))
+    {
+        value = strtok_r(NULL, " \t", &save);
+        if (!value || !APEX_cpu_set_option(cpu, name, value))
+        {
+            fprintf(stderr, "APEX_Error: Bad option %s in configuration \"%s\"\n",
+                    name, config);
+            free(options);
+            return FALSE;
+        }
+    }
+    free(options);
+
+    if (!APEX_cpu_options_valid(cpu))
+    {
+        return FALSE;
+    }
+
+    /* Only the table is reported */
+    if (!freopen("/dev/null", "w", stdout))
+    {
+        return FALSE;
+    }
+
+    /* Data memory stays shared with the parent until stored to */
+    APEX_cpu_restart(cpu);
+    APEX_cpu_run(cpu);
+
+    result->status = cpu->run_status;
+    result->cycles = cpu->clock;
+    result->insns = cpu->insn_completed;
+    result->decode_stall_cycles = cpu->decode_stall_cycles;
+    result->fetch_stall_cycles = cpu->fetch_stall_cycles;
+    result->done = TRUE;
+    return TRUE;
+}
+
+/*
+ * Sweep driver, see the top of this file. The prefix is set by the
+ * fastforward options of cpu, and is empty without them
+ */
+void
+APEX_sweep_run(APEX_CPU *cpu, const char *const *configs, int num_configs)
+{
+    APEX_Sweep_Result *results;
+    const char *status;
+    size_t bytes = num_configs * sizeof(APEX_Sweep_Result);
+    pid_t *children;
+    int prefix = RUN_RETIRED;
+    int i;
+
+    if (num_configs == 0)
+    {
+        fprintf(stderr, "APEX_Error: The sweep has no configuration\n");
+        return;
+    }
+
+    if (cpu->fast_forward_insns > 0 || cpu->fast_forward_pc > 0)
+    {
+        prefix = APEX_functional_run(
+            cpu, cpu->fast_forward_insns > 0 ? cpu->fast_forward_insns : -1,
+            cpu->fast_forward_pc > 0 ? cpu->fast_forward_pc : -1);
+    }
+    if (prefix == RUN_LEFT_CODE)
+    {
+        fprintf(stderr, "APEX_Error: The program left code memory at PC %d\n", cpu->pc);
+        return;
+    }
+    printf("APEX_SWEEP: Prefix of %d instructions to PC %d\n",
+           cpu->insn_completed, cpu->pc);
+    if (prefix == RUN_HALTED)
+    {
+        printf("APEX_SWEEP: The program halted in the prefix\n");
+        return;
+    }
+
+    results = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    children = calloc(num_configs, sizeof(pid_t));
+    if (results == MAP_FAILED || !children)
+    {
+        fprintf(stderr, "APEX_Error: Unable to set up the sweep\n");
+        if (results != MAP_FAILED)
+        {
+            munmap(results, bytes);
+        }
+        free(children);
+        return;
+    }
+
+    /* Buffered output would be written again by every child */
+    fflush(stdout);
+    fflush(stderr);
+
+    for (i = 0; i < num_configs; i++)
+    {
+        children[i] = fork();
+        if (children[i] == 0)
+        {
+            _exit(run_config(cpu, configs[i], &results[i]) ? 0 : 1);
+        }
+        if (children[i] < 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to fork configuration %d\n", i);
+        }
+    }
+
+    for (i = 0; i < num_configs; i++)
+    {
+        if (children[i] > 0)
+        {
+            waitpid(children[i], NULL, 0);
+        }
+    }
+
+    for (i = 0; i < num_configs; i++)
+    {
+        if (!results[i].done)
+        {
+            printf("APEX_SWEEP: Configuration %d \"%s\": Failed\n", i,
+                   configs[i]);
+            continue;
+        }
+
+        status = results[i].status == RUN_HALTED       ? "Complete"
+                 : results[i].status == RUN_DEADLOCKED ? "Deadlocked"
+                                                       : "Stopped";
+        printf("APEX_SWEEP: Configuration %d \"%s\": %s, cycles = %d instructions = %d decode stalls = %d fetch stalls = %d\n",
+               i, configs[i], status, results[i].cycles, results[i].insns,
+               results[i].decode_stall_cycles, results[i].fetch_stall_cycles);
+    }
+
+    munmap(results, bytes);
+    free(children);
+}
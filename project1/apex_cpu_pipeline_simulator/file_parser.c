@@ -0,0 +1,658 @@
+/*
+ * file_parser.c
+ * Contains functions to parse input file and create code memory, you can edit
+ * this file to add new instructions
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+
+/*
+ * Reads the number of an operand between p and end, skipping its first
+ * character, the R of a register or the # of an immediate, then as atoi
+ * does
+ */
+static int
+get_num_from_string(const char *p, const char *end)
+{
+    unsigned int value = 0;
+    int negative = FALSE;
+
+    for (p++; p < end && isspace((unsigned char)*p); p++)
+    {
+    }
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+    for (; p < end && isdigit((unsigned char)*p); p++)
+    {
+        value = value * 10 + (*p - '0');
+    }
+
+    return negative ? -(int)value : (int)value;
+}
+
+/* Mnemonics of all instructions, indexed by numeric opcode. This is the only
+ * copy of the text, code memory holds numeric opcodes */
+static const char *const opcode_mnemonics[NUM_OPCODES] = {
+    [OPCODE_ADD] = "ADD",
+    [OPCODE_SUB] = "SUB",
+    [OPCODE_MUL] = "MUL",
+    [OPCODE_DIV] = "DIV",
+    [OPCODE_AND] = "AND",
+    [OPCODE_OR] = "OR",
+    [OPCODE_XOR] = "EXOR",
+    [OPCODE_MOVC] = "MOVC",
+    [OPCODE_LOAD] = "LOAD",
+    [OPCODE_STORE] = "STORE",
+    [OPCODE_BZ] = "BZ",
+    [OPCODE_BNZ] = "BNZ",
+    [OPCODE_HALT] = "HALT",
+    [OPCODE_STR] = "STR",
+    [OPCODE_LDR] = "LDR",
+    [OPCODE_ADDL] = "ADDL",
+    [OPCODE_SUBL] = "SUBL",
+    [OPCODE_CMP] = "CMP",
+};
+
+/* Register operands of an instruction */
+#define READS_RS1 0x1
+#define READS_RS2 0x2
+#define WRITES_RD 0x4
+
+/* Operands, functional unit and properties of all instructions, indexed by
+ * numeric opcode. STORE and STR read their data register rd in the memory
+ * stage, outside of the decode interlock, so it is not a decode source.
+ * CMP continues into the BZ redirect in execute, so it counts as a branch */
+static const struct
+{
+    unsigned char operands;
+    unsigned char fu_class;
+    unsigned char flags;
+} opcode_properties[NUM_OPCODES] = {
+    [OPCODE_ADD] = {READS_RS1 | READS_RS2 | WRITES_RD, FU_INT, INSN_SETS_ZERO_FLAG},
+    [OPCODE_SUB] = {READS_RS1 | READS_RS2 | WRITES_RD, FU_INT, INSN_SETS_ZERO_FLAG},
+    [OPCODE_MUL] = {READS_RS1 | READS_RS2 | WRITES_RD, FU_MUL, INSN_SETS_ZERO_FLAG},
+    [OPCODE_DIV] = {READS_RS1 | READS_RS2 | WRITES_RD, FU_MUL, INSN_SETS_ZERO_FLAG},
+    [OPCODE_AND] = {READS_RS1 | READS_RS2 | WRITES_RD, FU_INT, INSN_SETS_ZERO_FLAG},
+    [OPCODE_OR] = {READS_RS1 | READS_RS2 | WRITES_RD, FU_INT, INSN_SETS_ZERO_FLAG},
+    [OPCODE_XOR] = {READS_RS1 | READS_RS2 | WRITES_RD, FU_INT, INSN_SETS_ZERO_FLAG},
+    [OPCODE_MOVC] = {WRITES_RD, FU_INT, INSN_SETS_ZERO_FLAG},
+    [OPCODE_LOAD] = {READS_RS1 | WRITES_RD, FU_MEM, INSN_LOAD},
+    [OPCODE_STORE] = {READS_RS1, FU_MEM, INSN_STORE},
+    [OPCODE_BZ] = {0, FU_BRANCH, INSN_READS_ZERO_FLAG | INSN_BRANCH},
+    [OPCODE_BNZ] = {0, FU_BRANCH, INSN_READS_ZERO_FLAG | INSN_BRANCH},
+    [OPCODE_HALT] = {0, FU_NONE, INSN_HALT},
+    [OPCODE_STR] = {READS_RS1 | READS_RS2, FU_MEM, INSN_STORE},
+    [OPCODE_LDR] = {READS_RS1 | READS_RS2 | WRITES_RD, FU_MEM, INSN_LOAD},
+    [OPCODE_ADDL] = {READS_RS1 | WRITES_RD, FU_INT, 0},
+    [OPCODE_SUBL] = {READS_RS1 | WRITES_RD, FU_INT, 0},
+    [OPCODE_CMP] = {READS_RS1 | READS_RS2, FU_INT,
+                    INSN_SETS_ZERO_FLAG | INSN_READS_ZERO_FLAG | INSN_BRANCH},
+};
+
+/*
+ * Returns the mnemonic of a numeric opcode, for printing instructions
+ */
+const char *
+get_opcode_mnemonic(int opcode)
+{
+    return opcode_mnemonics[opcode];
+}
+
+/* Perfect hash of the mnemonics, see opcode_hash. The multipliers are
+ * chosen so that no two mnemonics share a slot, which build_opcode_table
+ * checks */
+#define OPCODE_HASH_SIZE 32
+#define OPCODE_HASH(s, len) (((s)[0] * 12 + (s)[1] * 6 + (len)) & (OPCODE_HASH_SIZE - 1))
+
+/* Opcode plus one by hash slot, zero for an empty slot */
+static unsigned char opcode_table[OPCODE_HASH_SIZE];
+static pthread_once_t opcode_table_once = PTHREAD_ONCE_INIT;
+
+static void
+build_opcode_table(void)
+{
+    const char *mnemonic;
+    int opcode;
+    int slot;
+
+    for (opcode = 0; opcode < NUM_OPCODES; ++opcode)
+    {
+        mnemonic = opcode_mnemonics[opcode];
+        slot = OPCODE_HASH(mnemonic, strlen(mnemonic));
+        assert(!opcode_table[slot] && "Mnemonics collide in opcode_table");
+        opcode_table[slot] = opcode + 1;
+    }
+}
+
+/*
+ * Returns the numeric opcode of the len characters of mnemonic, or -1 if
+ * they are no mnemonic
+ *
+ * Note : add the mnemonic of new instructions to opcode_mnemonics
+ */
+static int
+opcode_hash(const char *mnemonic, size_t len)
+{
+    int opcode;
+
+    if (len < 2 || len > 5)
+    {
+        return -1;
+    }
+
+    pthread_once(&opcode_table_once, build_opcode_table);
+    opcode = opcode_table[OPCODE_HASH((const unsigned char *)mnemonic, len)] - 1;
+    if (opcode < 0 || strlen(opcode_mnemonics[opcode]) != len
+        || memcmp(mnemonic, opcode_mnemonics[opcode], len) != 0)
+    {
+        return -1;
+    }
+    return opcode;
+}
+
+/*
+ * Returns the numeric opcode of a mnemonic, or -1 if there is none
+ */
+int
+find_opcode(const char *opcode_str)
+{
+    return opcode_hash(opcode_str, strlen(opcode_str));
+}
+
+/*
+ * This function is related to parsing input file. The line runs from line
+ * to end, without its newline: the mnemonic, then after spaces the
+ * operands separated by commas, anything after further spaces being
+ * dropped. Missing operands read as 0.
+ *
+ * Returns FALSE if the line does not start with a mnemonic
+ *
+ * Note : you can edit this function to add new instructions
+ */
+static int
+parse_line(APEX_Instruction *ins, const char *line, const char *end)
+{
+    const char *tokens[6];
+    const char *token_ends[6];
+    const char *mnemonic;
+    const char *p;
+    int token_num = 0;
+    int opcode;
+
+    for (p = line; p < end && *p == ' '; p++)
+    {
+    }
+    for (mnemonic = p; p < end && *p != ' '; p++)
+    {
+    }
+
+    opcode = opcode_hash(mnemonic, p - mnemonic);
+    if (opcode < 0)
+    {
+        return FALSE;
+    }
+    ins->opcode = opcode;
+
+    /* Operands, empty ones between commas are skipped */
+    for (; p < end && *p == ' '; p++)
+    {
+    }
+    while (p < end && *p != ' ' && token_num < 6)
+    {
+        if (*p == ',')
+        {
+            p++;
+            continue;
+        }
+        tokens[token_num] = p;
+        for (; p < end && *p != ' ' && *p != ','; p++)
+        {
+        }
+        token_ends[token_num] = p;
+        token_num++;
+    }
+    for (; token_num < 6; token_num++)
+    {
+        tokens[token_num] = token_ends[token_num] = end;
+    }
+
+#define OPERAND(i) get_num_from_string(tokens[i], token_ends[i])
+    switch (ins->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_STR:
+        case OPCODE_LDR:
+        {
+            ins->rd = OPERAND(0);
+            ins->rs1 = OPERAND(1);
+            ins->rs2 = OPERAND(2);
+            break;
+        }
+        case OPCODE_CMP:
+        {
+            ins->rs1 = OPERAND(0);
+            ins->rs2 = OPERAND(1);
+        }
+        case OPCODE_MOVC:
+        {
+            ins->rd = OPERAND(0);
+            ins->imm = OPERAND(1);
+            break;
+        }
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_LOAD:
+        case OPCODE_STORE:
+        {
+            ins->rd = OPERAND(0);
+            ins->rs1 = OPERAND(1);
+            ins->imm = OPERAND(2);
+            break;
+        }
+
+
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        {
+            ins->imm = OPERAND(0);
+            break;
+        }
+    }
+#undef OPERAND
+    /* Fill in rest of the instructions accordingly */
+    return TRUE;
+}
+
+/*
+ * Parses one line of an input file into ins, for the assembler
+ */
+void
+parse_instruction(APEX_Instruction *ins, const char *line)
+{
+    memset(ins, 0, sizeof(*ins));
+    parse_line(ins, line, line + strcspn(line, "\n"));
+}
+
+/*
+ * Allocates zeroed code memory for size instructions and the padding after
+ * them, from arena or from the heap if arena is NULL or too small for it
+ */
+static APEX_Instruction *
+alloc_code_memory(int size, APEX_Arena *arena)
+{
+    APEX_Instruction *code_memory;
+    size_t code_memory_bytes;
+
+    code_memory_bytes = (size + CODE_MEMORY_PADDING) * sizeof(APEX_Instruction);
+    code_memory_bytes = (code_memory_bytes + CODE_MEMORY_ALIGN - 1)
+                        & ~(size_t)(CODE_MEMORY_ALIGN - 1);
+    code_memory = arena ? APEX_arena_alloc(arena, code_memory_bytes) : NULL;
+    if (!code_memory)
+    {
+        code_memory = aligned_alloc(CODE_MEMORY_ALIGN, code_memory_bytes);
+    }
+    if (code_memory)
+    {
+        memset(code_memory, 0, code_memory_bytes);
+    }
+    return code_memory;
+}
+
+/*
+ * Loads the binary image written by apex_asm, mapped at image, see
+ * APEX_Image_Header. The initial data memory of the image is stored into
+ * data_memory unless it is NULL.
+ *
+ * Returns NULL if the image is damaged or does not fit this build
+ */
+static APEX_Instruction *
+load_program_image(const unsigned char *image, size_t bytes,
+                   const char *filename, int *size, APEX_Arena *arena,
+                   APEX_Memory *data_memory)
+{
+    const APEX_Image_Header *header = (const APEX_Image_Header *)image;
+    APEX_Instruction *code_memory;
+    const int *data;
+    unsigned int i;
+
+    if (header->version != APEX_IMAGE_VERSION || header->num_insns == 0
+        || header->num_insns > (bytes - sizeof(*header)) / sizeof(APEX_Instruction)
+        || bytes != sizeof(*header)
+                        + header->num_insns * sizeof(APEX_Instruction)
+                        + (size_t)header->num_data * sizeof(int))
+    {
+        fprintf(stderr, "APEX_Error: %s is damaged or of another version\n",
+                filename);
+        return NULL;
+    }
+    code_memory = alloc_code_memory(header->num_insns, arena);
+    if (!code_memory)
+    {
+        return NULL;
+    }
+
+    memcpy(code_memory, image + sizeof(*header),
+           header->num_insns * sizeof(APEX_Instruction));
+    if (data_memory)
+    {
+        data = (const int *)(image + sizeof(*header)
+                             + header->num_insns * sizeof(APEX_Instruction));
+        for (i = 0; i < header->num_data; i++)
+        {
+            APEX_memory_store(data_memory, i, data[i]);
+        }
+    }
+    *size = header->num_insns;
+    return code_memory;
+}
+
+/* Part of a text file parsed by one thread, see parse_text */
+typedef struct APEX_Parse_Chunk
+{
+    const char *start;             /* Start of a line */
+    const char *end;               /* Past the newline ending the chunk */
+    int first_line;                /* Index of its first line in the file */
+    int num_lines;
+    APEX_Instruction *code_memory;
+    int error_line;                /* First line without a mnemonic, or -1 */
+    const char *error_text;
+} APEX_Parse_Chunk;
+
+static void *
+count_chunk_lines(void *arg)
+{
+    APEX_Parse_Chunk *chunk = arg;
+    const char *p = chunk->start;
+    const char *newline;
+
+    chunk->num_lines = 0;
+    while (p < chunk->end
+           && (newline = memchr(p, '\n', chunk->end - p)) != NULL)
+    {
+        chunk->num_lines++;
+        p = newline + 1;
+    }
+
+    /* The last line of the file may have no newline */
+    if (p < chunk->end)
+    {
+        chunk->num_lines++;
+    }
+    return NULL;
+}
+
+static void *
+parse_chunk(void *arg)
+{
+    APEX_Parse_Chunk *chunk = arg;
+    const char *p = chunk->start;
+    const char *newline;
+    const char *line_end;
+    int line = chunk->first_line;
+
+    chunk->error_line = -1;
+    while (p < chunk->end)
+    {
+        newline = memchr(p, '\n', chunk->end - p);
+        line_end = newline ? newline : chunk->end;
+
+        if (!parse_line(&chunk->code_memory[line], p, line_end)
+            && chunk->error_line < 0)
+        {
+            chunk->error_line = line;
+            chunk->error_text = p;
+        }
+
+        line++;
+        p = newline ? newline + 1 : chunk->end;
+    }
+    return NULL;
+}
+
+/*
+ * Runs fn on every chunk, each on a thread of its own but for the first,
+ * which runs on the calling thread
+ */
+static void
+run_chunks(APEX_Parse_Chunk *chunks, int num_chunks, void *(*fn)(void *))
+{
+    pthread_t threads[PARSE_MAX_THREADS];
+    int started[PARSE_MAX_THREADS];
+    int i;
+
+    for (i = 1; i < num_chunks; i++)
+    {
+        started[i] = pthread_create(&threads[i], NULL, fn, &chunks[i]) == 0;
+        if (!started[i])
+        {
+            fn(&chunks[i]);
+        }
+    }
+    fn(&chunks[0]);
+
+    for (i = 1; i < num_chunks; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+/*
+ * Parses the bytes of text, one instruction per line. The text is split on
+ * newlines into one chunk per thread, the threads count the lines of their
+ * chunk, then parse them into their slots of code memory.
+ *
+ * Returns NULL if there is no line, or a line has no valid mnemonic
+ */
+static APEX_Instruction *
+parse_text(const char *text, size_t bytes, const char *filename, int *size,
+           APEX_Arena *arena)
+{
+    APEX_Parse_Chunk chunks[PARSE_MAX_THREADS];
+    APEX_Instruction *code_memory;
+    const char *boundary;
+    long num_threads;
+    int num_chunks;
+    int num_lines = 0;
+    int i;
+
+    num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    num_chunks = bytes / PARSE_CHUNK_BYTES + 1;
+    if (num_chunks > num_threads)
+    {
+        num_chunks = num_threads > 0 ? num_threads : 1;
+    }
+    if (num_chunks > PARSE_MAX_THREADS)
+    {
+        num_chunks = PARSE_MAX_THREADS;
+    }
+
+    /* Every chunk but the first starts after a newline */
+    chunks[0].start = text;
+    for (i = 1; i < num_chunks; i++)
+    {
+        boundary = text + bytes / num_chunks * i;
+        if (boundary < chunks[i - 1].start)
+        {
+            boundary = chunks[i - 1].start;
+        }
+        boundary = memchr(boundary, '\n', text + bytes - boundary);
+        chunks[i].start = boundary ? boundary + 1 : text + bytes;
+        chunks[i - 1].end = chunks[i].start;
+    }
+    chunks[num_chunks - 1].end = text + bytes;
+
+    run_chunks(chunks, num_chunks, count_chunk_lines);
+    for (i = 0; i < num_chunks; i++)
+    {
+        chunks[i].first_line = num_lines;
+        num_lines += chunks[i].num_lines;
+    }
+    *size = num_lines;
+    if (!num_lines)
+    {
+        return NULL;
+    }
+
+    code_memory = alloc_code_memory(num_lines, arena);
+    if (!code_memory)
+    {
+        return NULL;
+    }
+    for (i = 0; i < num_chunks; i++)
+    {
+        chunks[i].code_memory = code_memory;
+    }
+
+    run_chunks(chunks, num_chunks, parse_chunk);
+
+    /* Chunks are in file order, the first error found is the first line */
+    for (i = 0; i < num_chunks; i++)
+    {
+        if (chunks[i].error_line >= 0)
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: Invalid instruction %.*s\n",
+                    filename, chunks[i].error_line + 1,
+                    (int)strcspn(chunks[i].error_text, "\n"),
+                    chunks[i].error_text);
+            if (!APEX_arena_owns(arena, code_memory))
+            {
+                free(code_memory);
+            }
+            return NULL;
+        }
+    }
+    return code_memory;
+}
+
+/*
+ * This function is related to parsing input file. Code memory comes from
+ * arena, or from the heap if arena is NULL or too small. The file is mapped, and
+ * parsed as text unless it is a binary image written by apex_asm. Images
+ * may set the initial data memory, which is left as is for text files;
+ * data_memory may be NULL.
+ *
+ * Note : You are not supposed to edit this function
+ */
+APEX_Instruction *
+create_code_memory(const char *filename, int *size, APEX_Arena *arena,
+                   APEX_Memory *data_memory)
+{
+    APEX_Instruction *code_memory;
+    const char *text;
+    struct stat st;
+    int fd;
+
+    if (!filename)
+    {
+        return NULL;
+    }
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    if ((size_t)st.st_size >= sizeof(APEX_Image_Header)
+        && memcmp(text, APEX_IMAGE_MAGIC, sizeof(APEX_IMAGE_MAGIC)) == 0)
+    {
+        code_memory = load_program_image((const unsigned char *)text,
+                                         st.st_size, filename, size, arena,
+                                         data_memory);
+    }
+    else
+    {
+        code_memory = parse_text(text, st.st_size, filename, size, arena);
+    }
+
+    munmap((void *)text, st.st_size);
+    return code_memory;
+}
+
+/*
+ * Builds the static dependency information of every code memory slot,
+ * including the padding slots after the last instruction, in arena or on
+ * the heap if arena is NULL or too small
+ */
+APEX_Insn_Deps *
+create_insn_deps(const APEX_Instruction *code_memory, int size,
+                 APEX_Arena *arena)
+{
+    APEX_Insn_Deps *code_deps;
+    int operands;
+    int i;
+
+    code_deps = arena ? APEX_arena_alloc(arena, (size + CODE_MEMORY_PADDING)
+                                                    * sizeof(APEX_Insn_Deps))
+                      : NULL;
+    if (!code_deps)
+    {
+        code_deps = calloc(size + CODE_MEMORY_PADDING, sizeof(APEX_Insn_Deps));
+    }
+    if (!code_deps)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < size + CODE_MEMORY_PADDING; ++i)
+    {
+        operands = opcode_properties[code_memory[i].opcode].operands;
+
+        if (operands & READS_RS1)
+        {
+            code_deps[i].src_mask |= 1 << code_memory[i].rs1;
+        }
+        if (operands & READS_RS2)
+        {
+            code_deps[i].src_mask |= 1 << code_memory[i].rs2;
+        }
+        if (operands & WRITES_RD)
+        {
+            code_deps[i].dest_mask = 1 << code_memory[i].rd;
+        }
+        code_deps[i].fu_class = opcode_properties[code_memory[i].opcode].fu_class;
+        code_deps[i].flags = opcode_properties[code_memory[i].opcode].flags;
+    }
+
+    return code_deps;
+}
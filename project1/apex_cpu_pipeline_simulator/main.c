@@ -0,0 +1,158 @@
+/*
+ * main.c
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "apex_cpu.h"
+#include <string.h>
+
+int main(int argc, char const *argv[])
+{
+    APEX_CPU *cpu;
+    APEX_Batch *batch;
+    const char **configs;
+    const char *restore_file = NULL;
+    const char *data_image = NULL;
+    unsigned int data_base = 0;
+    int num_configs = 0;
+    int i;
+
+    fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
+
+    if (argc >= 4 && strcmp(argv[1], "batch") == 0)
+    {
+        /* Every input file is an independent instance */
+        batch = APEX_batch_init(&argv[3], argc - 3);
+        if (!batch)
+        {
+            fprintf(stderr, "APEX_Error: Unable to initialize batch\n");
+            exit(1);
+        }
+        APEX_batch_run(batch, atoi(argv[2]));
+        APEX_batch_report(batch);
+        APEX_batch_stop(batch);
+        return 0;
+    }
+
+    if (argc >= 4 && strcmp(argv[1], "manifest") == 0)
+    {
+        /* Optional thread count after the two files */
+        return APEX_manifest_run(argv[2], argv[3],
+                                 (argc >= 6 && strcmp(argv[4], "threads") == 0)
+                                     ? atoi(argv[5])
+                                     : 0)
+                   ? 0
+                   : 1;
+    }
+
+    if (argc < 4 || argc % 2)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> simulate|display "
+                "<cycles> [fastforward <insns>] [fastforward_pc <pc>] "
+                "[jit 0|1] [decoupled 0|1] [snapshot <file>] "
+                "[snapshot_cycle <cycle>] [snapshot_every <cycles>] "
+                "[restore <file>] [dump <file>] [display_diff 0|1] "
+                "[data_image <file>] [data_base <address>] [cache <dir>] "
+                "[incremental <dir>] [incremental_every <cycles>]\n",
+                argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> sample <cycles> "
+                "[sample_period <insns>] [sample_warmup <insns>] "
+                "[sample_window <insns>]\n",
+                argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> interval <cycles> "
+                "[interval_insns <insns>] [interval_warmup <insns>] "
+                "[threads <n>] [verify 0|1]\n",
+                argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> sweep <cycles> "
+                "[fastforward <insns>] [fastforward_pc <pc>] "
+                "config \"<option> <value>...\"...\n",
+                argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s batch <cycles> <input_file>...\n",
+                argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s manifest <manifest_file> "
+                "<results_file> [threads <n>]\n",
+                argv[0]);
+        exit(1);
+    }
+    int cycles = atoi(argv[3]);
+    cpu = APEX_cpu_init(argv[1],argv[2],cycles);
+    if (!cpu)
+    {
+        fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+        exit(1);
+    }
+
+    /* Options come in name value pairs after the cycle count */
+    configs = calloc(argc / 2, sizeof(const char *));
+    for (i = 4; configs && i < argc; i += 2)
+    {
+        if (strcmp(argv[i], "config") == 0)
+        {
+            configs[num_configs++] = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "snapshot") == 0)
+        {
+            cpu->snapshot_file = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "dump") == 0)
+        {
+            cpu->dump_file = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "cache") == 0)
+        {
+            cpu->cache_dir = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "incremental") == 0)
+        {
+            cpu->incremental_dir = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "restore") == 0)
+        {
+            restore_file = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "data_image") == 0)
+        {
+            data_image = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "data_base") == 0)
+        {
+            data_base = strtoul(argv[i + 1], NULL, 0);
+        }
+        else if (!APEX_cpu_set_option(cpu, argv[i], argv[i + 1]))
+        {
+            fprintf(stderr, "APEX_Error: Unknown option %s\n", argv[i]);
+            free(configs);
+            APEX_cpu_stop(cpu);
+            exit(1);
+        }
+    }
+
+    if (!configs || !APEX_cpu_options_valid(cpu)
+        || (data_image
+            && !APEX_memory_map_image(&cpu->data_memory, data_image,
+                                      data_base))
+        || (restore_file && !APEX_snapshot_restore(cpu, restore_file)))
+    {
+        free(configs);
+        APEX_cpu_stop(cpu);
+        exit(1);
+    }
+
+    if (strcmp(argv[2], "sweep") == 0)
+    {
+        /* Every configuration continues from the same prefix */
+        APEX_sweep_run(cpu, configs, num_configs);
+        free(configs);
+        APEX_cpu_stop(cpu);
+        return 0;
+    }
+    free(configs);
+
+    APEX_cpu_run(cpu);
+    APEX_cpu_stop(cpu);
+    return 0;
+}
\ No newline at end of file
@@ -1,8 +0,0 @@
-MOVC R0,#4000
-MOVC R1,#1
-MOVC R2,#2
-MOVC R3,#3
-MOVC R4,#1
-ADD R5,R0,R1
-SUB R3,R3,R4
-HALT
\ No newline at end of file